@@ -0,0 +1,97 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// Benchmark harness: Each benchmark defines its name, unit and bench fn,
+// and main prints one JSON line with throughput and GC statistics.
+// Usage: bench_<name>.out [scale (default 1)]
+// With BENCH_PERF=1 in the environment, hardware counters of GC phases are
+// also printed as "perf", if available. (See zGCSetPerfCounters)
+// Define BENCH_MINOR_HEAP before including this to set the minor heap size,
+// or BENCH_NO_MAIN to write own main.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../zzcore.h"
+
+#ifndef BENCH_MINOR_HEAP
+#define BENCH_MINOR_HEAP 0 // default
+#endif
+
+extern const char *BENCH_NAME;
+extern const char *BENCH_UNIT;
+
+// Run the benchmark and return # of operations (in BENCH_UNIT)
+zu_t bench(zgc_t *G, double scale);
+
+static double benchNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t bench_rand = 88172645463325252u;
+static inline zu_t benchRand(zu_t n) {
+  // Random integer in [0, n) by xorshift
+  bench_rand ^= bench_rand << 13;
+  bench_rand ^= bench_rand >> 7;
+  bench_rand ^= bench_rand << 17;
+  return (zu_t) (bench_rand % n);
+}
+
+static inline int benchPerf(zgc_t *G) {
+  // Enable hardware counters if BENCH_PERF is set, and return 1 if enabled
+  const char * const perf = getenv("BENCH_PERF");
+  return perf && atoi(perf) > 0 && zGCSetPerfCounters(G, 1) > 0;
+}
+
+static inline void benchPrintPerf(const zgcstats_t *st) {
+  // ,"perf":{"<phase>":{"<counter>":n,...,"ipc":x},...} (minor + full)
+  int k, i;
+  printf(",\"perf\":{");
+  for(k = 0; k < ZZ_PERF_PHASES; k++) {
+    uint64_t v[ZZ_PERF_N];
+    printf("%s\"%s\":{", k ? "," : "", zGCEventName(k));
+    for(i = 0; i < ZZ_PERF_N; i++) {
+      v[i] = st->minor.perf[k][i] + st->full.perf[k][i];
+      printf("%s\"%s\":%llu", i ? "," : "", zGCPerfName(i),
+        (unsigned long long) v[i]);
+    }
+    printf(",\"ipc\":%.3f}", v[ZZ_PERF_CYCLES] ?
+      (double) v[ZZ_PERF_INSTRUCTIONS] / v[ZZ_PERF_CYCLES] : 0.0);
+  }
+  printf("}");
+}
+
+#ifndef BENCH_NO_MAIN
+int main(int argc, char **argv) {
+  const double scale = argc > 1 ? atof(argv[1]) : 1.0;
+  zgc_t *G = zNewGC(16, BENCH_MINOR_HEAP);
+  zgcstats_t st;
+  if(G == NULL) {
+    fprintf(stderr, "%s: failed to create GC\n", BENCH_NAME);
+    return 1;
+  }
+  const int perf_on = benchPerf(G);
+  const double t0 = benchNow();
+  const zu_t ops = bench(G, scale > 0 ? scale : 1.0);
+  const double t = benchNow() - t0;
+  zGCGetStats(G, &st);
+  const uint64_t max_pause = st.minor.max_pause_ns > st.full.max_pause_ns ?
+    st.minor.max_pause_ns : st.full.max_pause_ns;
+  printf("{\"bench\":\"%s\",\"unit\":\"%s\",\"ops\":%lu,\"secs\":%.6f,"
+    "\"ops_per_sec\":%.1f,\"minor_gcs\":%lu,\"full_gcs\":%lu,"
+    "\"gc_secs\":%.6f,\"max_pause_ms\":%.3f,\"heap_words\":%lu",
+    BENCH_NAME, BENCH_UNIT, (unsigned long) ops, t, ops / t,
+    (unsigned long) st.minor.count, (unsigned long) st.full.count,
+    (st.minor.pause_ns + st.full.pause_ns) * 1e-9, max_pause * 1e-6,
+    (unsigned long) zGCReservedSlots(G, -1));
+  if(perf_on) benchPrintPerf(&st);
+  printf("}\n");
+  zDelGC(G);
+  return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#include "bench.h"
+const char *BENCH_NAME = "binarytrees";
+const char *BENCH_UNIT = "nodes";
+
+// GCBench (Ellis & Kovac, Boehm): Temporary binary trees of various depths
+// with a long-lived tree and a large array
+
+#define MIN_DEPTH 4
+#define MAX_DEPTH 16
+#define LONG_LIVED_DEPTH 16
+#define STRETCH_DEPTH 18
+#define ARRAY_SIZE 500000
+
+static ztag_t *slots[2 * (STRETCH_DEPTH + 1)]; // children in construction
+static zu_t n_nodes = 0;
+
+static ztup_t *make(zgc_t *G, int d) {
+  // Bottom-up, thus children are older than their parents
+  ztup_t *t;
+  if(d == 0) {
+    t = zAllocTup(G, 0, 2);
+    t->slots[0] = t->slots[1] = NULL;
+  } else {
+    slots[2 * d]->t = make(G, d - 1);
+    slots[2 * d + 1]->t = make(G, d - 1);
+    t = zAllocTup(G, d, 2);
+    t->slots[0] = slots[2 * d]->t;
+    t->slots[1] = slots[2 * d + 1]->t;
+    slots[2 * d]->p = slots[2 * d + 1]->p = NULL;
+  }
+  n_nodes++;
+  return t;
+}
+
+static zu_t check(ztup_t *t) {
+  return t ? 1 + check(t->slots[0]) + check(t->slots[1]) : 0;
+}
+
+static zu_t treeSize(int d) {
+  return ((zu_t) 1 << (d + 1)) - 1;
+}
+
+zu_t bench(zgc_t *G, double scale) {
+  int d, k;
+  zGCPushFrame(G, 2 * (STRETCH_DEPTH + 1) + 2);
+  for(k = 0; k < 2 * (STRETCH_DEPTH + 1); k++) slots[k] = zGCTopFrameSlot(G, k);
+  ztag_t * const long_lived = zGCTopFrameSlot(G, k);
+  ztag_t * const array = zGCTopFrameSlot(G, k + 1);
+  // Stretch the heap
+  if(check(make(G, STRETCH_DEPTH)) != treeSize(STRETCH_DEPTH)) goto L_fail;
+  // Long-lived data
+  long_lived->t = make(G, LONG_LIVED_DEPTH);
+  array->p = zAlloc(G, ARRAY_SIZE, 0);
+  for(k = 0; k < ARRAY_SIZE / 2; k++) {
+    ((zf_t*) array->p)[k] = 1.0 / k;
+    ((zf_t*) array->p)[ARRAY_SIZE - 1 - k] = 1.0 / k;
+  }
+  // Temporary trees
+  for(d = MIN_DEPTH; d <= MAX_DEPTH; d += 2) {
+    const zu_t n = (zu_t) (2 * treeSize(STRETCH_DEPTH) / treeSize(d) * scale);
+    zu_t i;
+    for(i = 0; i < n; i++) {
+      if(check(make(G, d)) != treeSize(d)) goto L_fail;
+  } }
+  if(check(long_lived->t) != treeSize(LONG_LIVED_DEPTH) ||
+    ((zf_t*) array->p)[1000] != 1.0 / 1000) goto L_fail;
+  zGCPopFrame(G);
+  return n_nodes;
+L_fail:
+  fprintf(stderr, "%s: wrong tree\n", BENCH_NAME);
+  exit(1);
+}
@@ -0,0 +1,43 @@
+#include "bench.h"
+const char *BENCH_NAME = "cyclic";
+const char *BENCH_UNIT = "mutations";
+
+// Mutable cyclic graph: Nodes are replaced by new ones, and edges of random
+// nodes are redirected to new nodes. (cyclic references are enabled)
+
+#define NODES 20000
+#define EDGES 4
+#define MUTATIONS 1000000
+
+zu_t bench(zgc_t *G, double scale) {
+  const zu_t n = (zu_t) (MUTATIONS * scale);
+  zu_t i, k;
+  zAllowCyclicRefGC(G, 1);
+  zGCPushFrame(G, 1);
+  ztag_t * const nodes = zGCTopFrameSlot(G, 0);
+  nodes->t = zAllocTup(G, 0, NODES);
+  for(i = 0; i < NODES; i++) {
+    ztup_t * const x = zAllocTup(G, i, EDGES);
+    for(k = 0; k < EDGES; k++) x->slots[k] = x;
+    nodes->t->slots[i] = x;
+  }
+  for(i = 0; i < NODES; i++) {
+    for(k = 0; k < EDGES; k++)
+      nodes->t->slots[i]->slots[k] = nodes->t->slots[benchRand(NODES)];
+  }
+  for(i = 0; i < n; i++) {
+    const zu_t j = benchRand(NODES);
+    ztup_t * const x = zAllocTup(G, j, EDGES);
+    ztup_t ** const v = nodes->t->slots;
+    for(k = 0; k < EDGES; k++) x->slots[k] = v[benchRand(NODES)];
+    v[j] = x;
+    v[benchRand(NODES)]->slots[benchRand(EDGES)] = x;
+  }
+  for(i = 0; i < NODES; i++) {
+    if(nodes->t->slots[i]->tag.u != i) {
+      fprintf(stderr, "%s: wrong graph\n", BENCH_NAME);
+      exit(1);
+  } }
+  zGCPopFrame(G);
+  return n;
+}
@@ -0,0 +1,45 @@
+#include "bench.h"
+const char *BENCH_NAME = "deeproots";
+const char *BENCH_UNIT = "objects";
+
+// Deep recursion: Each level pushes a root frame with live objects, and
+// allocations at the bottom make GC scan the deep root stack.
+
+#define DEPTH 10000
+#define SLOTS 4
+#define ROUNDS 40
+#define LEAF_ALLOCS 20000
+
+static zu_t n_objs = 0;
+
+static int recur(zgc_t *G, int d, zu_t leaf) {
+  int k, ok = 1;
+  zu_t i;
+  zGCPushFrame(G, SLOTS);
+  for(k = 0; k < SLOTS; k++) {
+    zGCSetTopFrame(G, k, (ztag_t) {.t = zAllocTup(G, d, 0)}, 0);
+    n_objs++;
+  }
+  if(d > 0) ok = recur(G, d - 1, leaf);
+  else {
+    for(i = 0; i < leaf; i++) {
+      ztup_t * const t = zAllocTup(G, i, 1);
+      t->slots[0] = zGCTopFrame(G, i % SLOTS).t;
+    }
+    n_objs += leaf;
+  }
+  for(k = 0; k < SLOTS; k++) ok &= zGCTopFrame(G, k).t->tag.u == (zu_t) d;
+  zGCPopFrame(G);
+  return ok;
+}
+
+zu_t bench(zgc_t *G, double scale) {
+  const int rounds = (int) (ROUNDS * scale) > 0 ? (int) (ROUNDS * scale) : 1;
+  int r;
+  for(r = 0; r < rounds; r++) {
+    if(!recur(G, DEPTH, LEAF_ALLOCS)) {
+      fprintf(stderr, "%s: wrong roots\n", BENCH_NAME);
+      exit(1);
+  } }
+  return n_objs;
+}
@@ -0,0 +1,43 @@
+#define BENCH_MINOR_HEAP (1 << 14)
+#include "bench.h"
+const char *BENCH_NAME = "large";
+const char *BENCH_UNIT = "objects";
+
+// Large-object churn: Objects larger than the minor heap are allocated
+// directly in major gens. A ring of them is kept alive in roots.
+
+#define RING 16
+#define OBJECTS 1000
+#define MIN_WORDS BENCH_MINOR_HEAP
+#define MAX_WORDS (BENCH_MINOR_HEAP * 4)
+
+zu_t bench(zgc_t *G, double scale) {
+  const zu_t n = (zu_t) (OBJECTS * scale);
+  zu_t i, k;
+  zGCPushFrame(G, RING);
+  for(i = 0; i < n; i++) {
+    const zu_t sz = MIN_WORDS + benchRand(MAX_WORDS - MIN_WORDS);
+    zu_t *x;
+    if(i % 4 == 0) {
+      // Pointer array, which refers objects in the ring
+      x = zAlloc(G, 1, sz);
+      x[0] = i;
+      for(k = 0; k < sz; k++) x[1 + k] = (zu_t) zGCTopFrame(G, k % RING).p;
+    } else {
+      // Non-pointer buffer
+      x = zAlloc(G, sz, 0);
+      x[0] = i;
+      x[sz - 1] = i;
+    }
+    zGCSetTopFrame(G, i % RING, (ztag_t) {.p = x}, 0);
+    // Small objects between large ones
+    for(k = 0; k < 1000; k++) zAllocTup(G, k, 0);
+  }
+  for(k = 0; k < RING && k < n; k++) {
+    if(((zu_t*) zGCTopFrame(G, k).p)[0] % RING != k) {
+      fprintf(stderr, "%s: wrong object\n", BENCH_NAME);
+      exit(1);
+  } }
+  zGCPopFrame(G);
+  return n;
+}
@@ -0,0 +1,190 @@
+#define BENCH_NO_MAIN
+#include "bench.h"
+
+// Pause latency: A request-like mutator loop with a steady live set, over
+// nursery sizes and major heap minimum sizes. Every collection is timed by
+// the GC event hook, and each configuration prints a JSON line with pause
+// percentiles and minimum mutator utilization (MMU) for window sizes.
+// Usage: bench_latency.out [scale] [allocation rate in words/ms (0: max)]
+//   [idle (1: call zGCIdle until the next request, only with a rate)]
+// (BENCH_PERF=1 adds hardware counters, as other benchmarks)
+
+#define REQUESTS 20000
+#define LIVE_SLOTS 4096 // live set: each slot has a list of LIST_LEN tuples
+#define LIST_LEN 16
+#define REPLACE 4 // # of slots replaced per request
+#define TEMP_OBJS 500 // # of temporary objects per request
+
+static const zu_t minor_sizes[] = {1 << 14, 1 << 16, 1 << 18, 1 << 20};
+static const zu_t major_sizes[] = {1 << 16, 1 << 18, 1 << 20};
+static const double windows_ms[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+
+#define N_MINOR (sizeof(minor_sizes) / sizeof(minor_sizes[0]))
+#define N_MAJOR (sizeof(major_sizes) / sizeof(major_sizes[0]))
+#define N_WINDOWS (sizeof(windows_ms) / sizeof(windows_ms[0]))
+
+typedef struct pauses {
+  zu_t n, cap;
+  uint64_t *b, *e; // begin & end in ns
+} pauses_t;
+
+static void hook(zgc_t *G, const zgcevent_t *ev, zp_t ud) {
+  pauses_t * const P = (pauses_t*) ud;
+  if(ev->kind != ZZ_EV_GC) return;
+  if(ev->begin) {
+    if(P->n >= P->cap) {
+      P->cap = P->cap ? P->cap << 1 : 1024;
+      P->b = (uint64_t*) realloc(P->b, sizeof(uint64_t) * P->cap);
+      P->e = (uint64_t*) realloc(P->e, sizeof(uint64_t) * P->cap);
+    }
+    P->b[P->n] = ev->ts;
+  } else P->e[P->n++] = ev->ts;
+}
+
+static int cmpU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t gcTimeIn(pauses_t *P, uint64_t *acc, uint64_t a, uint64_t b) {
+  // Total pause time in [a, b), where acc is the prefix sum of pauses
+  zu_t l = 0, r = P->n, i, j;
+  uint64_t t;
+  // First pause ending after a
+  while(l < r) {
+    const zu_t m = (l + r) / 2;
+    if(P->e[m] <= a) l = m + 1;
+    else r = m;
+  }
+  i = l;
+  // First pause beginning at or after b
+  for(l = i, r = P->n; l < r;) {
+    const zu_t m = (l + r) / 2;
+    if(P->b[m] < b) l = m + 1;
+    else r = m;
+  }
+  j = l;
+  if(i >= j) return 0;
+  t = acc[j] - acc[i];
+  if(P->b[i] < a) t -= a - P->b[i];
+  if(P->e[j - 1] > b) t -= P->e[j - 1] - b;
+  return t;
+}
+
+static double mmu(pauses_t *P, uint64_t t0, uint64_t t1, double w_ms) {
+  // Min. over windows of (1 - GC time / window). The worst window begins at
+  // a pause begin or ends at a pause end.
+  const uint64_t w = (uint64_t) (w_ms * 1e6);
+  uint64_t *acc = (uint64_t*) malloc(sizeof(uint64_t) * (P->n + 1));
+  double u = 1.0;
+  zu_t i;
+  if(t1 - t0 < w) {
+    free(acc);
+    return -1; // Not measured
+  }
+  acc[0] = 0;
+  for(i = 0; i < P->n; i++) acc[i + 1] = acc[i] + (P->e[i] - P->b[i]);
+  for(i = 0; i < P->n; i++) {
+    uint64_t a = P->b[i] + w <= t1 ? P->b[i] : t1 - w;
+    double v = 1.0 - (double) gcTimeIn(P, acc, a, a + w) / w;
+    if(v < u) u = v;
+    a = P->e[i] >= t0 + w ? P->e[i] - w : t0;
+    v = 1.0 - (double) gcTimeIn(P, acc, a, a + w) / w;
+    if(v < u) u = v;
+  }
+  free(acc);
+  return u < 0 ? 0 : u;
+}
+
+static ztup_t *makeList(zgc_t *G, zu_t id) {
+  // List of young tuples (each points the previous one)
+  zu_t k;
+  zGCSetTopFrame(G, LIVE_SLOTS, (ztag_t) {.p = NULL}, 0);
+  for(k = 0; k < LIST_LEN; k++) {
+    ztup_t * const t = zAllocTup(G, id, 1);
+    t->slots[0] = zGCTopFrame(G, LIVE_SLOTS).t;
+    zGCSetTopFrame(G, LIVE_SLOTS, (ztag_t) {.t = t}, 0);
+  }
+  return zGCTopFrame(G, LIVE_SLOTS).t;
+}
+
+static void run(zu_t minor, zu_t major, zu_t requests, double rate,
+  int idle) {
+  zgc_t *G = zNewGC(1, minor);
+  pauses_t P;
+  zu_t i, k, words = 0;
+  if(G == NULL) {
+    fprintf(stderr, "latency: failed to create GC\n");
+    exit(1);
+  }
+  memset(&P, 0, sizeof(P));
+  zSetMajorMinSizeGC(G, major);
+  zGCSetHook(G, hook, &P);
+  const int perf_on = benchPerf(G);
+  zGCPushFrame(G, LIVE_SLOTS + 1);
+  for(i = 0; i < LIVE_SLOTS; i++)
+    zGCSetTopFrame(G, i, (ztag_t) {.t = makeList(G, i)}, 0);
+  P.n = 0; // Pauses in setup are ignored
+  zGCResetStats(G);
+  const double t0 = benchNow();
+  const uint64_t ts0 = (uint64_t) (t0 * 1e9);
+  for(i = 0; i < requests; i++) {
+    // Temporary objects
+    for(k = 0; k < TEMP_OBJS; k++) zAllocTup(G, k, 1)->slots[0] = NULL;
+    // Replace a part of the live set
+    for(k = 0; k < REPLACE; k++) {
+      const zu_t j = benchRand(LIVE_SLOTS);
+      zGCSetTopFrame(G, j, (ztag_t) {.t = makeList(G, j)}, 0);
+    }
+    words += TEMP_OBJS * 2 + REPLACE * LIST_LEN * 2;
+    // Throttle allocation (idle time is mutator time)
+    if(rate > 0) {
+      const double next = t0 + words / (rate * 1e3);
+      if(idle) zGCIdle(G, (uint64_t) (next * 1e9));
+      while(benchNow() < next);
+    }
+  }
+  const double t = benchNow() - t0;
+  const uint64_t ts1 = (uint64_t) ((t0 + t) * 1e9);
+  // Pause percentiles
+  uint64_t *d = (uint64_t*) malloc(sizeof(uint64_t) * (P.n + 1));
+  for(i = 0; i < P.n; i++) d[i] = P.e[i] - P.b[i];
+  qsort(d, P.n, sizeof(uint64_t), cmpU64);
+#define PCT(p) (P.n ? d[(zu_t) ((P.n - 1) * (p))] * 1e-6 : 0)
+  zgcstats_t st;
+  zGCGetStats(G, &st);
+  printf("{\"bench\":\"latency\",\"minor_heap\":%lu,\"major_min\":%lu,"
+    "\"idle\":%d,\"idle_gcs\":%lu,\"requests\":%lu,\"secs\":%.6f,\"alloc_words_per_ms\":%.1f,"
+    "\"pauses\":%lu,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,"
+    "\"max_ms\":%.3f,\"mmu\":{",
+    (unsigned long) minor, (unsigned long) major, idle,
+    (unsigned long) st.idle_gcs, (unsigned long) requests,
+    t, words / (t * 1e3), (unsigned long) P.n, PCT(0.5), PCT(0.99),
+    PCT(0.999), PCT(1.0));
+#undef PCT
+  for(k = 0; k < N_WINDOWS; k++) {
+    const double u = mmu(&P, ts0, ts1, windows_ms[k]);
+    if(u < 0) break;
+    printf("%s\"%g\":%.4f", k ? "," : "", windows_ms[k], u);
+  }
+  printf("}");
+  if(perf_on) benchPrintPerf(&st);
+  printf("}\n");
+  fflush(stdout);
+  free(d), free(P.b), free(P.e);
+  zGCSetHook(G, NULL, NULL);
+  zDelGC(G);
+}
+
+int main(int argc, char **argv) {
+  const double scale = argc > 1 && atof(argv[1]) > 0 ? atof(argv[1]) : 1.0;
+  const double rate = argc > 2 ? atof(argv[2]) : 0;
+  const int idle = argc > 3 ? atoi(argv[3]) : 0;
+  const zu_t requests = (zu_t) (REQUESTS * scale);
+  zu_t i, j;
+  for(i = 0; i < N_MINOR; i++) {
+    for(j = 0; j < N_MAJOR; j++) run(minor_sizes[i], major_sizes[j], requests,
+      rate, idle);
+  }
+  return 0;
+}
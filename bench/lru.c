@@ -0,0 +1,75 @@
+#include "bench.h"
+const char *BENCH_NAME = "lru";
+const char *BENCH_UNIT = "ops";
+
+// LRU cache: A map from keys to nodes of a doubly linked list, which is
+// mutated on every hit and miss (cyclic references are enabled)
+
+#define CAPACITY 50000
+#define KEYS (CAPACITY * 2) // ~50% hit rate
+#define OPS 2000000
+#define VALUE_WORDS 8
+
+// Node: tag = key, slots = [prev, next, value]
+#define PREV 0
+#define NEXT 1
+#define VALUE 2
+
+static void unlink(ztup_t *x) {
+  x->slots[PREV]->slots[NEXT] = x->slots[NEXT];
+  x->slots[NEXT]->slots[PREV] = x->slots[PREV];
+}
+
+static void pushFront(ztup_t *head, ztup_t *x) {
+  x->slots[PREV] = head;
+  x->slots[NEXT] = head->slots[NEXT];
+  head->slots[NEXT]->slots[PREV] = x;
+  head->slots[NEXT] = x;
+}
+
+zu_t bench(zgc_t *G, double scale) {
+  const zu_t ops = (zu_t) (OPS * scale);
+  zu_t i, n = 0, hits = 0;
+  zAllowCyclicRefGC(G, 1);
+  zGCPushFrame(G, 3);
+  ztag_t * const map = zGCTopFrameSlot(G, 0);
+  ztag_t * const head = zGCTopFrameSlot(G, 1);
+  ztag_t * const tmp = zGCTopFrameSlot(G, 2);
+  map->p = zAllocMap(G, 16);
+  // Sentinel of the circular list
+  head->t = zAllocTup(G, 0, 3);
+  head->t->slots[PREV] = head->t->slots[NEXT] = head->t;
+  head->t->slots[VALUE] = NULL;
+  for(i = 0; i < ops; i++) {
+    const zp_t key = zInt(benchRand(KEYS));
+    ztup_t *x = (ztup_t*) zMapGet(G, (zmap_t*) map->p, key);
+    if(x) {
+      // Hit: move to front
+      hits++;
+      unlink(x);
+      pushFront(head->t, x);
+      continue;
+    }
+    // Miss: insert a new value
+    tmp->t = zAllocTup(G, zIntOf(key), VALUE_WORDS);
+    memset(tmp->t->slots, 0, sizeof(zp_t) * VALUE_WORDS);
+    x = zAllocTup(G, zIntOf(key), 3);
+    x->slots[VALUE] = tmp->t;
+    pushFront(head->t, x);
+    tmp->t = x;
+    map->p = zMapPut(G, (zmap_t*) map->p, key, x);
+    tmp->p = NULL;
+    if(++n > CAPACITY) {
+      // Evict the least recently used
+      ztup_t * const y = head->t->slots[PREV];
+      unlink(y);
+      zMapDel(G, (zmap_t*) map->p, zInt(y->tag.u));
+      n--;
+  } }
+  if(n != CAPACITY || ((zmap_t*) map->p)->n != CAPACITY || hits == 0) {
+    fprintf(stderr, "%s: wrong cache\n", BENCH_NAME);
+    exit(1);
+  }
+  zGCPopFrame(G);
+  return ops;
+}
@@ -0,0 +1,82 @@
+#define BENCH_NO_MAIN
+#include "bench.h"
+
+// Nursery sizes: Throughput of a short-lived allocation workload (small
+// temporary trees with a steady live set) over minor heap sizes, and with
+// minor heaps fitted to each cache level (zNewGCCache). Each
+// configuration prints a JSON line.
+// Usage: bench_nursery.out [scale]
+
+#define NODES 2000000 // # of allocated nodes per configuration
+#define TREE_DEPTH 6
+#define LIVE_SLOTS 1024
+#define MIN_SHIFT 12
+#define MAX_SHIFT 22
+
+static ztag_t *slots[2 * (TREE_DEPTH + 1)]; // children in construction
+static zu_t n_nodes;
+
+static ztup_t *make(zgc_t *G, int d) {
+  ztup_t *t;
+  if(d == 0) {
+    t = zAllocTup(G, 0, 2);
+    t->slots[0] = t->slots[1] = NULL;
+  } else {
+    slots[2 * d]->t = make(G, d - 1);
+    slots[2 * d + 1]->t = make(G, d - 1);
+    t = zAllocTup(G, d, 2);
+    t->slots[0] = slots[2 * d]->t;
+    t->slots[1] = slots[2 * d + 1]->t;
+    slots[2 * d]->p = slots[2 * d + 1]->p = NULL;
+  }
+  n_nodes++;
+  return t;
+}
+
+static void run(const char *config, zgc_t *G, zu_t nodes) {
+  zgcstats_t st;
+  int k;
+  if(G == NULL) {
+    fprintf(stderr, "nursery: failed to create GC\n");
+    exit(1);
+  }
+  zGCPushFrame(G, 2 * (TREE_DEPTH + 1));
+  for(k = 0; k < 2 * (TREE_DEPTH + 1); k++) slots[k] = zGCTopFrameSlot(G, k);
+  n_nodes = 0;
+  const double t0 = benchNow();
+  while(n_nodes < nodes) {
+    ztup_t * const t = make(G, TREE_DEPTH);
+    // 1 of 16 trees is kept for a while
+    if(benchRand(16) == 0)
+      zGCSetBotFrame(G, (int) benchRand(LIVE_SLOTS), (ztag_t) {.t = t}, 0);
+  }
+  const double t = benchNow() - t0;
+  zGCGetStats(G, &st);
+  const zu_t words = zGCReservedSlots(G, 0);
+  printf("{\"bench\":\"nursery\",\"config\":\"%s\",\"minor_heap\":%lu,"
+    "\"minor_bytes\":%lu,\"nodes\":%lu,\"secs\":%.6f,\"nodes_per_sec\":%.1f,"
+    "\"minor_gcs\":%lu,\"gc_secs\":%.6f}\n",
+    config, (unsigned long) words,
+    (unsigned long) (words * (sizeof(zu_t) + 2)), (unsigned long) n_nodes, t,
+    n_nodes / t, (unsigned long) st.minor.count,
+    (st.minor.pause_ns + st.full.pause_ns) * 1e-9);
+  fflush(stdout);
+  zDelGC(G);
+}
+
+int main(int argc, char **argv) {
+  const double scale = argc > 1 && atof(argv[1]) > 0 ? atof(argv[1]) : 1.0;
+  const zu_t nodes = (zu_t) (NODES * scale);
+  char config[16];
+  int k;
+  for(k = MIN_SHIFT; k <= MAX_SHIFT; k++) {
+    snprintf(config, sizeof(config), "2^%d", k);
+    run(config, zNewGC(LIVE_SLOTS, (zu_t) 1 << k), nodes);
+  }
+  for(k = 1; k <= 3; k++) {
+    if(zGCCacheBytes(k) == 0) continue;
+    snprintf(config, sizeof(config), "L%d", k);
+    run(config, zNewGCCache(LIVE_SLOTS, k), nodes);
+  }
+  return 0;
+}
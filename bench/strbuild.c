@@ -0,0 +1,40 @@
+#include "bench.h"
+const char *BENCH_NAME = "strbuild";
+const char *BENCH_UNIT = "strings";
+
+// String building: Strings are built by appending to buffers, and some of
+// them are kept or interned.
+
+#define STRINGS 1000000
+#define KEEP 1024
+
+zu_t bench(zgc_t *G, double scale) {
+  const zu_t n = (zu_t) (STRINGS * scale);
+  zu_t i, len = 0;
+  int k;
+  char num[32];
+  zGCPushFrame(G, 2);
+  ztag_t * const buf = zGCTopFrameSlot(G, 0);
+  ztag_t * const keep = zGCTopFrameSlot(G, 1);
+  keep->t = zAllocTup(G, 0, KEEP);
+  memset(keep->t->slots, 0, sizeof(zp_t) * KEEP);
+  for(i = 0; i < n; i++) {
+    buf->p = zAllocBuf(G, 16);
+    const int parts = 1 + (int) benchRand(8);
+    for(k = 0; k < parts; k++) {
+      const int m = sprintf(num, "item-%lu/", (unsigned long) benchRand(100000));
+      buf->p = zBufAppend(G, (zbuf_t*) buf->p, num, m);
+    }
+    buf->p = zBufPush(G, (zbuf_t*) buf->p, '.');
+    zstr_t *s = zBufToStr(G, (zbuf_t*) buf->p);
+    len += s->len;
+    if(i % 16 == 0) s = zInternStr(G, s);
+    if(i % 4 == 0) keep->t->slots[benchRand(KEEP)] = (ztup_t*) s;
+  }
+  if(len < n * 8) {
+    fprintf(stderr, "%s: wrong strings\n", BENCH_NAME);
+    exit(1);
+  }
+  zGCPopFrame(G);
+  return n;
+}
@@ -0,0 +1,65 @@
+#include "test.h"
+const char *TEST_NAME = "09. Reserve allocation space";
+
+void test() {
+  zgc_t *G = zNewGC(2, 64);
+  assert(G != NULL);
+  // Fill minor heap with garbages
+  for(int i = 0; i < 5; i++) zAlloc(G, 1, 10);
+  zu_t left = zGCLeftSlots(G, 0);
+  assert(left < 40);
+  // Reserve 40 words: GC runs up front
+  assert(zGCReserve(G, 40) == 0);
+  assert(zGCLeftSlots(G, 0) >= 40);
+  // Build a list without roots. No GC must occur.
+  zp_t *l = NULL;
+  for(int i = 0; i < 10; i++) {
+    zp_t *n = (zp_t*) zAlloc(G, 1, 3);
+    n[0] = (zp_t) (zi_t) i;
+    n[1] = l;
+    n[2] = n[3] = NULL;
+    l = n;
+  }
+  assert(zGCLeftSlots(G, 0) == 64 - 40);
+  for(int i = 9; i >= 0; i--, l = l[1]) assert(l[0] == (zp_t) (zi_t) i);
+  assert(l == NULL);
+  // Already reserved
+  assert(zGCReserve(G, 24) == 1);
+  // Reserve more than minor heap: minor heap is extended
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = zAlloc(G, 1, 1)}, 0);
+  assert(zGCReserve(G, 100) == 0);
+  assert(zGCReservedSlots(G, 0) > 100);
+  zPrintGCStatus(G, NULL);
+  left = zGCLeftSlots(G, 0);
+  for(int i = 0; i < 25; i++) {
+    assert(zAlloc(G, 2, 2) != NULL);
+    assert(zGCLeftSlots(G, 0) == left - 4 * (i + 1));
+  }
+  // The minor heap is restored by the next GC
+  assert(zRunGC(G) == 0);
+  assert(zGCReservedSlots(G, 0) == 64);
+  zDelGC(G);
+  // At most one collection, even if gens should be merged after it
+  zgcstats_t st;
+  G = zNewGC(4, 64);
+  assert(G != NULL);
+  zSetMaxGensGC(G, 0);
+  for(int i = 0; i < 4; i++) {
+    zp_t *x = (zp_t*) zAlloc(G, 99, 1);
+    x[99] = NULL;
+    zGCSetBotFrame(G, i, (ztag_t) {.p = x}, 0);
+  }
+  assert(zGCNGen(G) > 3);
+  zSetMaxGensGC(G, 1);
+  for(int i = 0; i < 5; i++) zAlloc(G, 1, 10);
+  zGCGetStats(G, &st);
+  const zu_t count = st.minor.count + st.full.count;
+  assert(zGCReserve(G, 40) == 0);
+  zGCGetStats(G, &st);
+  assert(st.minor.count + st.full.count == count + 1);
+  // The next GC merges them
+  zAlloc(G, 1, 0);
+  assert(zRunGC(G) == 0);
+  assert(zGCNGen(G) <= 2);
+  zDelGC(G);
+}
@@ -0,0 +1,53 @@
+#include "test.h"
+const char *TEST_NAME = "10. Pinned objects";
+
+void test() {
+  zgc_t *G = zNewGC(4, 32);
+  assert(G != NULL);
+  // Pinned buffer which refers a movable object
+  zp_t *buf = (zp_t*) zAllocPinned(G, 4, 1);
+  assert(buf != NULL);
+  strcpy((char*) buf, "pinned buffer");
+  zp_t *x = (zp_t*) zAlloc(G, 1, 0);
+  x[0] = (zp_t) 0x1234;
+  buf[4] = x;
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = buf}, 0);
+  // Make garbages and run GCs
+  for(int i = 0; i < 1000; i++) zAlloc(G, 1, 2);
+  zRunGC(G);
+  zFullGC(G);
+  assert(zGCTopFrame(G, 0).p == buf);
+  assert(strcmp((char*) buf, "pinned buffer") == 0);
+  assert(buf[4] != x);
+  assert(((zp_t*) buf[4])[0] == (zp_t) 0x1234);
+  // Only pinned objects can be pinned
+  assert(zGCPin(G, buf[4]) == -1);
+  // Unreachable but pinned object is alive
+  zp_t *io = (zp_t*) zAllocPinned(G, 8, 0);
+  memset(io, 0x5a, 8 * sizeof(zp_t));
+  assert(zGCPin(G, io) == 1);
+  zFullGC(G);
+  for(int i = 0; i < 8 * (int) sizeof(zp_t); i++)
+    assert(((zb_t*) io)[i] == 0x5a);
+  // Unpinned and unreachable object is freed, so its space is reused
+  assert(zGCUnpin(G, io) == 0);
+  zFullGC(G);
+  zp_t *io2 = (zp_t*) zAllocPinned(G, 8, 0);
+  assert(io2 == io);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = io2}, 0);
+  // Unreachable pinned buffer is freed only after full marking
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  zRunGC(G);
+  zFullGC(G);
+  assert(zAllocPinned(G, 4, 1) == (zu_t*) buf);
+  // Pinned garbage is collected by full GC run by pinned allocation
+  zgcstats_t st;
+  zGCGetStats(G, &st);
+  const zu_t full = st.full.count;
+  for(int i = 0; i < 1 << 16; i++) zAllocPinned(G, 15, 0);
+  zGCGetStats(G, &st);
+  assert(st.full.count > full);
+  assert(zGCTopFrame(G, 1).p == io2);
+  zPrintGCStatus(G, NULL);
+  zDelGC(G);
+}
@@ -0,0 +1,53 @@
+#include "test.h"
+const char *TEST_NAME = "11. External memory and finalizers";
+
+#define EXT_SIZE (1 << 20)
+
+int n_alive = 0;
+
+void release(zgc_t *G, zp_t p, zp_t ud) {
+  // Release external buffer of the collected object
+  zp_t *obj = (zp_t*) p;
+  assert(((char*) obj[0])[0] == 'x');
+  free(obj[0]);
+  zGCSubExternalPressure(G, EXT_SIZE);
+  n_alive--;
+  (*(int*) ud)++;
+}
+
+void test() {
+  int n_finalized = 0;
+  zgc_t *G = zNewGC(4, 64);
+  assert(G != NULL);
+  // Objects holding large external buffers. Only the last 2 are reachable.
+  for(int i = 0; i < 200; i++) {
+    zp_t *obj = (zp_t*) zAlloc(G, 1, 0);
+    obj[0] = malloc(EXT_SIZE);
+    ((char*) obj[0])[0] = 'x';
+    n_alive++;
+    assert(zGCSetFinalizer(G, obj, release, &n_finalized) == 0);
+    zGCSetTopFrame(G, i % 2, (ztag_t) {.p = obj}, 0);
+    assert(zGCAddExternalPressure(G, EXT_SIZE) >= 0);
+    // External memory never grows too much
+    assert(zGCExternalBytes(G) <= 2 * (64 << 20) + EXT_SIZE);
+  }
+  printf("[INFO] finalized %d, alive %d, external %zu bytes\n",
+    n_finalized, n_alive, (size_t) zGCExternalBytes(G));
+  assert(n_finalized > 0);
+  assert(zGCExternalBytes(G) == (zu_t) n_alive * EXT_SIZE);
+  // Reachable objects are alive after full GC
+  zFullGC(G);
+  assert(n_alive == 2);
+  zp_t *obj = (zp_t*) zGCTopFrame(G, 0).p;
+  assert(((char*) obj[0])[0] == 'x');
+  // Reservation suspends GC by external memory
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = NULL}, 0);
+  assert(zGCReserve(G, 8) >= 0);
+  assert(zGCAddExternalPressure(G, 1 << 27) == 1);
+  assert(n_alive == 2);
+  zAlloc(G, 4, 4);
+  assert(zGCAddExternalPressure(G, 0) == 0);
+  assert(n_alive == 0);
+  zDelGC(G);
+}
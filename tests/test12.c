@@ -0,0 +1,91 @@
+#include "test.h"
+const char *TEST_NAME = "12. Weak references and ephemeron tables";
+
+zp_t *newObj(zgc_t *G, zi_t v) {
+  zp_t *x = (zp_t*) zAlloc(G, 1, 1);
+  x[0] = (zp_t) v;
+  x[1] = NULL;
+  return x;
+}
+
+void test() {
+  zgc_t *G = zNewGC(8, 64);
+  assert(G != NULL);
+  // -- Weak reference cells
+  zp_t *w = (zp_t*) zAllocWeak(G, 0, 2);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = w}, 0);
+  zp_t *a = newObj(G, 1);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = a}, 0);
+  w = zGCTopFrame(G, 0).p;
+  w[0] = a;
+  w[1] = newObj(G, 2); // only weakly reachable
+  zRunGC(G);
+  w = zGCTopFrame(G, 0).p;
+  a = zGCTopFrame(G, 1).p;
+  assert(w[0] == a && a[0] == (zp_t) 1);
+  assert(w[1] == NULL);
+  // Weak ref is cleared by full GC
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = NULL}, 0);
+  zFullGC(G);
+  w = zGCTopFrame(G, 0).p;
+  assert(w[0] == NULL);
+
+  // -- Ephemeron table
+  // Table and key array are mutated after promotion
+  zAllowCyclicRefGC(G, 1);
+  zmap_t *t = zAllocEph(G, 4);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = t}, 0);
+  // Keys 0..29: Only even keys are reachable from roots
+  zp_t *keys = (zp_t*) zAlloc(G, 0, 15);
+  for(int i = 0; i < 15; i++) keys[i] = NULL;
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = keys}, 0);
+  for(int i = 0; i < 30; i++) {
+    zp_t *k = newObj(G, i);
+    zGCSetTopFrame(G, 2, (ztag_t) {.p = k}, 0);
+    zp_t *v = newObj(G, 100 + i);
+    k = zGCTopFrame(G, 2).p;
+    // Value refers its key: it must not keep key alive
+    v[1] = k;
+    t = zMapPut(G, zGCTopFrame(G, 0).p, k, v);
+    assert(t != NULL);
+    zGCSetTopFrame(G, 0, (ztag_t) {.p = t}, 0);
+    keys = zGCTopFrame(G, 1).p;
+    if(i % 2 == 0) keys[i / 2] = zGCTopFrame(G, 2).p;
+  }
+  zGCSetTopFrame(G, 2, (ztag_t) {.p = NULL}, 0);
+  t = zGCTopFrame(G, 0).p;
+  assert(t->n >= 15 && t->n <= 30);
+  zFullGC(G);
+  t = zGCTopFrame(G, 0).p;
+  keys = zGCTopFrame(G, 1).p;
+  printf("[INFO] %zu entries in ephemeron table after GC\n", (size_t) t->n);
+  assert(t->n == 15);
+  for(int i = 0; i < 15; i++) {
+    zp_t *v = zMapGet(G, t, keys[i]);
+    assert(v != NULL && v[0] == (zp_t) (zi_t) (100 + 2 * i));
+    assert(v[1] == keys[i]);
+  }
+  // Chain: value of a key is another key
+  zp_t *k2 = newObj(G, 7);
+  zGCSetTopFrame(G, 2, (ztag_t) {.p = k2}, 0);
+  zp_t *v2 = newObj(G, 8);
+  k2 = zGCTopFrame(G, 2).p;
+  t = zMapPut(G, zGCTopFrame(G, 0).p, k2, v2);
+  keys = zGCTopFrame(G, 1).p;
+  t = zMapPut(G, t, keys[0], k2);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = t}, 0);
+  zGCSetTopFrame(G, 2, (ztag_t) {.p = NULL}, 0);
+  zFullGC(G);
+  t = zGCTopFrame(G, 0).p;
+  keys = zGCTopFrame(G, 1).p;
+  assert(t->n == 16);
+  k2 = zMapGet(G, t, keys[0]);
+  assert(k2 != NULL && k2[0] == (zp_t) 7);
+  assert(((zp_t*) zMapGet(G, t, k2))[0] == (zp_t) 8);
+  // Delete
+  assert(zMapDel(G, t, keys[1]) == 1);
+  assert(zMapGet(G, t, keys[1]) == NULL);
+  assert(zMapDel(G, t, keys[1]) == 0);
+  for(int i = 2; i < 15; i++) assert(zMapGet(G, t, keys[i]) != NULL);
+  zDelGC(G);
+}
@@ -0,0 +1,87 @@
+#include "test.h"
+const char *TEST_NAME = "13. Identity hash and map";
+
+#define N 200
+
+void test() {
+  zgc_t *G = zNewGC(4, 256);
+  assert(G != NULL);
+  zAllowCyclicRefGC(G, 1);
+  // Keys are kept in a tuple
+  ztup_t *keys = zAllocTup(G, 0, N);
+  zu_t hashes[N];
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = keys}, 0);
+  zmap_t *m = zAllocMap(G, 4);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = m}, 0);
+  for(int i = 0; i < N; i++) {
+    ztup_t *k = zAllocTup(G, i, 1);
+    k->slots[0] = NULL;
+    zGCSetTopFrame(G, 2, (ztag_t) {.t = k}, 0);
+    ztup_t *v = zAllocTup(G, 1000 + i, 0);
+    k = zGCTopFrame(G, 2).t;
+    hashes[i] = zGCIdHash(G, k);
+    assert(hashes[i] != 0);
+    assert(hashes[i] == zGCIdHash(G, k));
+    m = zMapPut(G, zGCTopFrame(G, 1).p, k, v);
+    assert(m != NULL);
+    zGCSetTopFrame(G, 1, (ztag_t) {.p = m}, 0);
+    keys = zGCTopFrame(G, 0).t;
+    keys->slots[i] = zGCTopFrame(G, 2).t;
+  }
+  zGCSetTopFrame(G, 2, (ztag_t) {.p = NULL}, 0);
+  // Hashes are preserved after objects are moved
+  m = zGCTopFrame(G, 1).p;
+  zu_t *hk = (zu_t*) malloc(sizeof(zu_t) * m->cap);
+  memcpy(hk, m->hk, sizeof(zu_t) * m->cap);
+  zFullGC(G);
+  keys = zGCTopFrame(G, 0).t;
+  m = zGCTopFrame(G, 1).p;
+  assert(m->n == N);
+  // No rehash
+  assert(memcmp(hk, m->hk, sizeof(zu_t) * m->cap) == 0);
+  for(int i = 0; i < N; i++) {
+    assert(zGCIdHash(G, keys->slots[i]) == hashes[i]);
+    ztup_t *v = zMapGet(G, m, keys->slots[i]);
+    assert(v != NULL && v->tag.u == (zu_t) (1000 + i));
+  }
+  // Non-objects are hashed by values
+  assert(zGCIdHash(G, (zp_t) 0x1230) == zGCIdHash(G, (zp_t) 0x1230));
+  m = zMapPut(G, m, (zp_t) 0x1230, keys);
+  assert(zMapGet(G, m, (zp_t) 0x1230) == keys);
+  // Unhashed object is not in map
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = m}, 0);
+  ztup_t *u = zAllocTup(G, 0, 0);
+  m = zGCTopFrame(G, 1).p;
+  keys = zGCTopFrame(G, 0).t;
+  assert(zMapGet(G, m, u) == NULL);
+  assert(zMapDel(G, m, u) == 0);
+  // Delete
+  for(int i = 0; i < N; i += 2) assert(zMapDel(G, m, keys->slots[i]) == 1);
+  assert(m->n == N / 2 + 1);
+  for(int i = 0; i < N; i++) {
+    ztup_t *v = zMapGet(G, m, keys->slots[i]);
+    assert(i % 2 == 0 ? v == NULL : v->tag.u == (zu_t) (1000 + i));
+  }
+  free(hk);
+  // Churn: hashed objects are moved or collected in every GC
+  ztup_t *kept = zAllocTup(G, 0, N);
+  for(int i = 0; i < N; i++) kept->slots[i] = NULL;
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = kept}, 0);
+  for(int r = 0; r < N / 4; r++) {
+    for(int i = 0; i < 8; i++) {
+      ztup_t *k = zAllocTup(G, r, 0);
+      const zu_t h = zGCIdHash(G, k);
+      assert(h == zGCIdHash(G, k));
+      if(i == 0) {
+        hashes[r] = h;
+        zGCTopFrame(G, 0).t->slots[r] = k;
+    } }
+    zRunGC(G);
+    kept = zGCTopFrame(G, 0).t;
+    for(int i = 0; i <= r; i++)
+      assert(zGCIdHash(G, kept->slots[i]) == hashes[i]);
+  }
+  // An immediate value same as the tombstone
+  assert(zGCIdHash(G, (zp_t) 1) == zGCIdHash(G, (zp_t) 1));
+  zDelGC(G);
+}
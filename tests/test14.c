@@ -0,0 +1,72 @@
+#include "test.h"
+const char *TEST_NAME = "14. String interning";
+
+#define N 300
+
+void test() {
+  zgc_t *G = zNewGC(4, 256);
+  assert(G != NULL);
+  zAllowCyclicRefGC(G, 1);
+  // Odd symbols are kept in a tuple, and all symbols are in a weak array
+  ztup_t *keep = zAllocTup(G, 0, N);
+  for(int i = 0; i < N; i++) keep->slots[i] = NULL;
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = keep}, 0);
+  zu_t *w = zAllocWeak(G, 0, N);
+  for(int i = 0; i < N; i++) w[i] = 0;
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = w}, 0);
+  char buf[32];
+  for(int i = 0; i < N; i++) {
+    int len = sprintf(buf, "sym%d", i);
+    zstr_t *s = zIntern(G, buf, len);
+    assert(s != NULL && s->len == (zu_t) len && strcmp(s->c, buf) == 0);
+    assert(zIntern(G, buf, len) == s);
+    w = zGCTopFrame(G, 1).p;
+    w[i] = (zu_t) s;
+    if(i % 2) {
+      keep = zGCTopFrame(G, 0).t;
+      keep->slots[i] = (zp_t) s;
+    }
+  }
+  zFullGC(G);
+  keep = zGCTopFrame(G, 0).t;
+  w = zGCTopFrame(G, 1).p;
+  for(int i = 0; i < N; i++) {
+    int len = sprintf(buf, "sym%d", i);
+    if(i % 2) {
+      // Moved symbols are still unique
+      zstr_t *s = (zstr_t*) keep->slots[i];
+      assert((zstr_t*) w[i] == s);
+      assert(s->hash != 0 && zStrHash(s) == s->hash);
+      assert(zIntern(G, buf, len) == s);
+      keep = zGCTopFrame(G, 0).t;
+      w = zGCTopFrame(G, 1).p;
+    } else {
+      // Unused symbols are collected
+      assert(w[i] == 0);
+    }
+  }
+  // Intern existing strings
+  zstr_t *a = zAllocStr(G, 4);
+  memcpy(a->c, "sym1", 4);
+  keep = zGCTopFrame(G, 0).t;
+  assert(zInternStr(G, a) == (zstr_t*) keep->slots[1]);
+  zstr_t *b = zAllocStr(G, 5);
+  memcpy(b->c, "fresh", 5);
+  assert(zInternStr(G, b) == b);
+  assert(zIntern(G, "fresh", 5) == b);
+  // Hash depends only on contents
+  zstr_t *c = zAllocStr(G, 5);
+  memcpy(c->c, "fresh", 5);
+  assert(c->hash == 0 && zStrHash(c) == b->hash);
+  // Manual allocation by the exported size
+  zu_t left = zGCLeftSlots(G, 0);
+  zstr_t *d = zAllocStr(G, 13);
+  if(left >= ZZ_STR_WORDS(13)) // No GC
+    assert(zGCLeftSlots(G, 0) == left - ZZ_STR_WORDS(13));
+  zstr_t *e = (zstr_t*) zAlloc(G, ZZ_STR_WORDS(5), 0);
+  e->len = 5, e->hash = 0;
+  memcpy(e->c, "fresh", 6);
+  assert(zStrHash(e) == zStrHash(c));
+  (void) d;
+  zDelGC(G);
+}
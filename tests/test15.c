@@ -0,0 +1,68 @@
+#include "test.h"
+const char *TEST_NAME = "15. String deduplication";
+
+#define N 400
+#define K 10
+
+static zstr_t *newStr(zgc_t *G, int i) {
+  char buf[64];
+  int len = sprintf(buf, "a long string value number %d", i % K);
+  zstr_t *s = zAllocStr(G, len);
+  memcpy(s->c, buf, len);
+  return s;
+}
+
+void test() {
+  zgc_t *G = zNewGC(4, 256);
+  assert(G != NULL);
+  zAllowCyclicRefGC(G, 1);
+  zSetStrDedupGC(G, 1);
+  ztup_t *t = zAllocTup(G, 0, N);
+  for(int i = 0; i < N; i++) t->slots[i] = NULL;
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+  zu_t h = 0;
+  for(int i = 0; i < N / 2; i++) {
+    zstr_t *s = newStr(G, i);
+    // A string with identity is not merged
+    if(i == K) h = zGCIdHash(G, s);
+    t = zGCTopFrame(G, 0).t;
+    t->slots[i] = (zp_t) s;
+  }
+  zFullGC(G);
+  t = zGCTopFrame(G, 0).t;
+  for(int i = 0; i < N / 2; i++) {
+    zstr_t *s = (zstr_t*) t->slots[i];
+    char buf[64];
+    sprintf(buf, "a long string value number %d", i % K);
+    assert(s->len == strlen(buf) && strcmp(s->c, buf) == 0);
+    if(i == K) assert(s != (zstr_t*) t->slots[0] && zGCIdHash(G, s) == h);
+    else if(i >= K) assert(s == (zstr_t*) t->slots[i % K]);
+  }
+  zu_t allocated = 0;
+  for(int k = 1; k < zGCNGen(G); k++) allocated += zGCAllocatedSlots(G, k);
+  assert(allocated < N * 2);
+  // New strings are merged into old ones
+  for(int i = N / 2; i < N; i++) {
+    zstr_t *s = newStr(G, i);
+    t = zGCTopFrame(G, 0).t;
+    t->slots[i] = (zp_t) s;
+  }
+  zRunGC(G);
+  t = zGCTopFrame(G, 0).t;
+  for(int i = N / 2; i < N; i++) {
+    zstr_t *s = (zstr_t*) t->slots[i];
+    assert(s == (zstr_t*) t->slots[i % K]);
+  }
+  // Without deduplication, strings are kept
+  zSetStrDedupGC(G, 0);
+  for(int i = 0; i < 2; i++) {
+    zstr_t *s = newStr(G, 1);
+    t = zGCTopFrame(G, 0).t;
+    t->slots[i] = (zp_t) s;
+  }
+  zFullGC(G);
+  t = zGCTopFrame(G, 0).t;
+  assert(t->slots[0] != t->slots[1]);
+  assert(strcmp(((zstr_t*) t->slots[0])->c, ((zstr_t*) t->slots[1])->c) == 0);
+  zDelGC(G);
+}
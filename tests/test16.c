@@ -0,0 +1,62 @@
+#include "test.h"
+const char *TEST_NAME = "16. Vector and buffer";
+
+#define N 2000
+
+void test() {
+  zgc_t *G = zNewGC(4, 512);
+  assert(G != NULL);
+  zAllowCyclicRefGC(G, 1);
+  // Push many objects, which runs GC several times
+  zvec_t *v = zAllocVec(G, 0);
+  assert(v != NULL && v->n == 0 && v->cap >= 1);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = v}, 0);
+  for(int i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, i, 0);
+    v = zVecPush(G, zGCTopFrame(G, 0).p, t);
+    assert(v != NULL && v->n == (zu_t) i + 1 && v->cap >= v->n);
+    zGCSetTopFrame(G, 0, (ztag_t) {.p = v}, 0);
+  }
+  zFullGC(G);
+  v = zGCTopFrame(G, 0).p;
+  for(int i = 0; i < N; i++)
+    assert(((ztup_t*) v->v[i])->tag.u == (zu_t) i);
+  // Bulk append of itself
+  v = zVecAppend(G, v, v->v, v->n);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = v}, 0);
+  assert(v->n == N * 2);
+  zFullGC(G);
+  v = zGCTopFrame(G, 0).p;
+  for(int i = 0; i < N * 2; i++)
+    assert(((ztup_t*) v->v[i])->tag.u == (zu_t) (i % N));
+  // Popped objects are collected
+  zu_t before = zGCAllocatedSlots(G, 1);
+  for(int i = 0; i < N * 3 / 2; i++)
+    assert(((ztup_t*) zVecPop(G, v))->tag.u == (zu_t) ((N * 2 - 1 - i) % N));
+  zFullGC(G);
+  v = zGCTopFrame(G, 0).p;
+  assert(v->n == N / 2);
+  assert(zGCAllocatedSlots(G, 1) < before);
+  // Unused slots are not traced, even if they have garbage
+  v->v[v->n] = (zp_t) 0x12345;
+  zFullGC(G);
+  // Buffer
+  zbuf_t *b = zAllocBuf(G, 0);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = b}, 0);
+  for(int i = 0; i < N; i++) {
+    char d[16];
+    int len = sprintf(d, "%d,", i % 10);
+    b = zBufAppend(G, zGCTopFrame(G, 1).p, d, len);
+    assert(b != NULL);
+    zGCSetTopFrame(G, 1, (ztag_t) {.p = b}, 0);
+    // Allocate garbage
+    zAllocTup(G, 0, 3);
+  }
+  b = zBufPush(G, zGCTopFrame(G, 1).p, '!');
+  assert(b->len == N * 2 + 1 && b->c[b->len] == '\0');
+  assert(strncmp(b->c, "0,1,2,", 6) == 0 && b->c[N * 2] == '!');
+  zstr_t *s = zBufToStr(G, b);
+  b = zGCTopFrame(G, 1).p;
+  assert(s->len == b->len && strcmp(s->c, b->c) == 0);
+  zDelGC(G);
+}
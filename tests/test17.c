@@ -0,0 +1,74 @@
+#include "test.h"
+const char *TEST_NAME = "17. HAMT";
+
+#define N 3000
+
+static zp_t key(int i) {
+  // Integer keys, hashed by values
+  return (zp_t) (zu_t) (i * 16 + 64);
+}
+
+static int sumFn(zp_t k, zp_t v, zp_t ud) {
+  *(zu_t*) ud += ((ztup_t*) v)->tag.u;
+  return 0;
+}
+
+void test() {
+  zgc_t *G = zNewGC(4, 1024);
+  assert(G != NULL);
+  ztup_t *m = zAllocHamt(G);
+  assert(zHamtCount(m) == 0 && zHamtGet(G, m, key(0)) == NULL);
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = m}, 0);
+  for(int i = 0; i < N; i++) {
+    ztup_t *v = zAllocTup(G, i, 0);
+    m = zHamtPut(G, zGCTopFrame(G, 0).t, key(i), v);
+    assert(m != NULL);
+    zGCSetTopFrame(G, 0, (ztag_t) {.t = m}, 0);
+    // Keep a old version
+    if(i == N / 2) zGCSetTopFrame(G, 1, (ztag_t) {.t = m}, 0);
+  }
+  zFullGC(G);
+  m = zGCTopFrame(G, 0).t;
+  assert(zHamtCount(m) == N);
+  for(int i = 0; i < N; i++) {
+    ztup_t *v = zHamtGet(G, m, key(i));
+    assert(v != NULL && v->tag.u == (zu_t) i);
+  }
+  assert(zHamtGet(G, m, key(N)) == NULL);
+  zu_t sum = 0;
+  zHamtEach(m, sumFn, &sum);
+  assert(sum == (zu_t) N * (N - 1) / 2);
+  // Old version is not changed
+  ztup_t *o = zGCTopFrame(G, 1).t;
+  assert(zHamtCount(o) == N / 2 + 1);
+  assert(zHamtGet(G, o, key(N / 2 + 1)) == NULL);
+  // Replace
+  m = zHamtPut(G, m, key(7), key(8));
+  assert(zHamtGet(G, m, key(7)) == key(8) && zHamtCount(m) == N);
+  assert(zHamtPut(G, m, key(7), key(8)) == m);
+  // Delete
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = m}, 0);
+  for(int i = 0; i < N; i += 2) {
+    m = zHamtDel(G, zGCTopFrame(G, 0).t, key(i));
+    zGCSetTopFrame(G, 0, (ztag_t) {.t = m}, 0);
+  }
+  assert(zHamtDel(G, m, key(0)) == m);
+  assert(zHamtCount(m) == N / 2);
+  for(int i = 0; i < N; i++)
+    assert((zHamtGet(G, m, key(i)) != NULL) == (i % 2 == 1));
+  for(int i = 1; i < N; i += 2) m = zHamtDel(G, m, key(i));
+  assert(zHamtCount(m) == 0);
+  // Same hashes (k and k + 1 have the same hash)
+  ztup_t *c = zAllocHamt(G);
+  for(int i = 0; i < 4; i++) c = zHamtPut(G, c, key(0) + i, key(i));
+  for(int i = 0; i < 4; i++) assert(zHamtGet(G, c, key(0) + i) == key(i));
+  c = zHamtDel(G, c, key(0) + 1);
+  assert(zHamtCount(c) == 3 && zHamtGet(G, c, key(0) + 1) == NULL);
+  for(int i = 0; i < 4; i += 2) c = zHamtDel(G, c, key(0) + i);
+  assert(zHamtCount(c) == 1 && zHamtGet(G, c, key(0) + 3) == key(3));
+  // Object keys
+  ztup_t *k = zAllocTup(G, 0, 0);
+  c = zHamtPut(G, c, k, k);
+  assert(zHamtGet(G, c, k) == k && zHamtCount(c) == 2);
+  zDelGC(G);
+}
@@ -0,0 +1,54 @@
+#include "test.h"
+const char *TEST_NAME = "18. Immediate values";
+
+#define N 1000
+
+void test() {
+  zgc_t *G = zNewGC(4, 256);
+  assert(G != NULL);
+  zAllowCyclicRefGC(G, 1);
+  // Integers
+  assert(zIntOf(zInt(0)) == 0 && zIntOf(zInt(-5)) == -5);
+  assert(zIntOf(zInt(ZZ_INT_MAX)) == ZZ_INT_MAX);
+  assert(zIntOf(zInt(ZZ_INT_MIN)) == ZZ_INT_MIN);
+  assert(zIsImm(zInt(3)) && zIsInt(zInt(3)) && !zIsFlo(zInt(3)));
+  // Floats
+  // (2.000000000001819 has bits 0x4000000000001000, near the code of 0.0)
+  zf_t fs[] = {0.0, 1.5, -2.25, 3.0e10, -1.0e-10, 2.000000000001819,
+    1.0e300, 1.0e-300, -0.0};
+  const int nfs = sizeof(fs) / sizeof(fs[0]);
+  ztup_t *t = zAllocTup(G, 0, N);
+  for(int i = 0; i < N; i++) t->slots[i] = NULL;
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+  for(int i = 0; i < nfs; i++) {
+    zp_t v = zFlo(G, fs[i]);
+    t = zGCTopFrame(G, 0).t;
+    t->slots[i] = v;
+    assert(zFloOf(v) == fs[i]);
+  }
+#if ZZ_SZPTR == 8
+  for(int i = 0; i < 6; i++) assert(zIsFlo(t->slots[i]));
+  for(int i = 6; i < nfs; i++) assert(!zIsImm(t->slots[i]));
+#endif
+  // Integers which look like (tagged) addresses of objects
+  for(int i = nfs; i < N; i++) {
+    ztup_t *x = zAllocTup(G, i, 0);
+    t = zGCTopFrame(G, 0).t;
+    t->slots[i] = (ztup_t*) ((zu_t) x | 1);
+    zGCSetTopFrame(G, 1, (ztag_t) {.u = (zu_t) x | 1}, 0);
+  }
+  zu_t saved[N];
+  memcpy(saved, t->slots, sizeof(zu_t) * N);
+  zu_t root = zGCTopFrame(G, 1).u;
+  zFullGC(G);
+  t = zGCTopFrame(G, 0).t;
+  // Immediate values are not changed
+  assert(zGCTopFrame(G, 1).u == root);
+  for(int i = nfs; i < N; i++) assert((zu_t) t->slots[i] == saved[i]);
+  for(int i = 0; i < nfs; i++) assert(zFloOf(t->slots[i]) == fs[i]);
+  // and objects are not kept by them
+  assert(zGCAllocatedSlots(G, -1) < N * 2);
+  // Object is aligned
+  assert(!zIsImm(t) && !zIsImm(zAllocTup(G, 0, 1)));
+  zDelGC(G);
+}
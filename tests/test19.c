@@ -0,0 +1,38 @@
+#include "test.h"
+const char *TEST_NAME = "19. Compressed references";
+
+#define N 100000
+
+void test() {
+  // Not available for normal GC
+  zgc_t *G = zNewGC(2, 0);
+  assert(zAllocCRef(G, 0, 1) == NULL);
+  zDelGC(G);
+  G = zNewCRefGC(4, 4096, (zu_t) 1 << 26);
+  assert(G != NULL);
+  // Cons cell (car, cdr) in a single word
+  ztup_t *v = zAllocTup(G, 12345, 0);
+  zGCSetTopFrame(G, 0, (ztag_t) {.t = v}, 0);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = NULL}, 0);
+  for(int i = 0; i < N; i++) {
+    zu_t *c = zAllocCRef(G, 0, 1);
+    assert(c != NULL);
+    zCRefSet(G, c, 0, zGCTopFrame(G, 0).p);
+    zCRefSet(G, c, 1, zGCTopFrame(G, 1).p);
+    zGCSetTopFrame(G, 1, (ztag_t) {.p = c}, 0);
+  }
+  zFullGC(G);
+  // Half of normal cons cells (2 words)
+  assert(zGCAllocatedSlots(G, -1) < N + 16);
+  v = zGCTopFrame(G, 0).t;
+  assert(v->tag.u == 12345);
+  int n = 0;
+  for(zu_t *c = zGCTopFrame(G, 1).p; c; c = zCRefGet(G, c, 1), n++)
+    assert(zCRefGet(G, c, 0) == v);
+  assert(n == N);
+  // Unreachable cells are collected
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = NULL}, 0);
+  zFullGC(G);
+  assert(zGCAllocatedSlots(G, -1) < 16);
+  zDelGC(G);
+}
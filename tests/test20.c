@@ -0,0 +1,57 @@
+#include "test.h"
+const char *TEST_NAME = "20. Shapes";
+
+#define N 5000
+
+typedef struct node {
+  zu_t id;
+  struct node *next;
+  zu_t addr; // non-pointer, which may look like a pointer
+  ztup_t *val;
+} node_t;
+
+void test() {
+  zgc_t *G = zNewGC(4, 512);
+  assert(G != NULL);
+  const zu_t mask = 0xa; // next and val
+  int sh = zRegisterShape(G, 4, &mask);
+  assert(sh >= 0);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(int i = 0; i < N; i++) {
+    ztup_t *v = zAllocTup(G, i, 0);
+    zGCSetTopFrame(G, 1, (ztag_t) {.t = v}, 0);
+    node_t *n = (node_t*) zAllocShape(G, sh);
+    n->id = i;
+    n->next = zGCTopFrame(G, 0).p;
+    n->val = zGCTopFrame(G, 1).t;
+    n->addr = (zu_t) n->val;
+    zGCSetTopFrame(G, 0, (ztag_t) {.p = n}, 0);
+  }
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = NULL}, 0);
+  node_t *n = zGCTopFrame(G, 0).p;
+  zu_t old = n->addr;
+  zFullGC(G);
+  n = zGCTopFrame(G, 0).p;
+  // Non-pointer words are not updated
+  assert(n->addr == old && (zu_t) n->val != old);
+  int k = N;
+  for(; n; n = n->next) {
+    --k;
+    assert(n->id == (zu_t) k && n->val->tag.u == (zu_t) k);
+  }
+  assert(k == 0);
+  // Large shape
+  zu_t big[zBytesToWords(1000 / 8 + 1)] = {0};
+  big[0] = 1;
+  int bsh = zRegisterShape(G, 1000, big);
+  zu_t *b = zAllocShape(G, bsh);
+  b[0] = (zu_t) zGCTopFrame(G, 0).p;
+  for(int i = 1; i < 1000; i++) b[i] = (zu_t) 0x1230;
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = b}, 0);
+  zFullGC(G);
+  b = zGCTopFrame(G, 0).p;
+  assert(((node_t*) b[0])->id == N - 1 && b[999] == 0x1230);
+  // Invalid ids
+  assert(zAllocShape(G, -1) == NULL && zAllocShape(G, bsh + 1) == NULL);
+  zDelGC(G);
+}
@@ -0,0 +1,94 @@
+#include "test.h"
+#include "../zzcore.hpp"
+const char *TEST_NAME = "21. C++ handles and typed allocation";
+
+struct Node {
+  zu_t id;
+  Node *next;
+  zf_t weight;
+  ztup_t *val;
+};
+
+struct Pair {
+  Node *a;
+  Node *b;
+};
+
+static_assert(zz::Layout<Node>::size == 4, "layout");
+static_assert(zz::Layout<Node>::bytes[0] == 1 && zz::Layout<Node>::bytes[1] == 0,
+  "layout");
+static_assert(zz::Layout<Node>::bytes[2] == 1 && zz::Layout<Node>::bytes[3] == 0,
+  "layout");
+
+struct Box { // plain layout: data, then pointers
+  zu_t id;
+  zf_t weight;
+  Node *node;
+};
+
+static_assert(!zz::Layout<Node>::plain, "layout");
+static_assert(zz::Layout<Pair>::plain && zz::Layout<Pair>::np == 0, "layout");
+static_assert(zz::Layout<Box>::plain && zz::Layout<Box>::np == 2, "layout");
+
+#define N 5000
+
+static void test2(zgc_t *G) {
+  zz::Root<Node> head(G, 0);
+  {
+    zz::Frame f(G, 3);
+    zz::Local<ztup_t> v(f);
+    for(zu_t i = 0; i < N; i++) {
+      v = zAllocTup(G, i, 0);
+      head = zz::make<Node>(G, i, head, (zf_t) i * 0.5, v);
+      assert(head != nullptr);
+    }
+    zz::Local<Node> next(f, head->next);
+    zz::Local<Pair> p(f, zz::make<Pair>(G, head, next));
+    zFullGC(G);
+    assert(p->a == head.get() && p->b == head->next);
+    // No more slots
+    bool thrown = false;
+    try {
+      zz::Local<ztup_t> x(f);
+    } catch(const std::length_error&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  zFullGC(G);
+  zu_t k = N;
+  for(Node *n = head; n; n = n->next) {
+    --k;
+    assert(n->id == k && n->weight == (zf_t) k * 0.5 && n->val->tag.u == k);
+  }
+  assert(k == 0);
+  // Frames are popped
+  assert(zGCTopFrameSize(G) == 2);
+}
+
+static void testPlain(zgc_t *G) {
+  // make of a plain layout is the same allocation as zAlloc in C
+  zz::Frame f(G, 2);
+  zz::Local<Box> b(f);
+  zz::Local<zu_t> c(f);
+  zRunGC(G);
+  for(zu_t i = 0; i < N; i++) {
+    const zu_t left = zGCLeftSlots(G, 0);
+    b = zz::make<Box>(G, i, (zf_t) i, nullptr);
+    assert(b != nullptr);
+    if(left >= 3) assert(zGCLeftSlots(G, 0) == left - 3); // No GC
+    c = zAlloc(G, 2, 1);
+    c[0] = i, c[1] = 0, c[2] = 0;
+  }
+  zFullGC(G);
+  assert(b->id == N - 1 && b->weight == (zf_t) (N - 1) && b->node == nullptr);
+  assert(c[0] == N - 1);
+}
+
+void test() {
+  zgc_t *G = zNewGC(2, 512);
+  assert(G != NULL);
+  test2(G);
+  testPlain(G);
+  zDelGC(G);
+}
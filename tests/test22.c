@@ -0,0 +1,66 @@
+#include "test.h"
+const char *TEST_NAME = "22. GC statistics";
+
+#define N 20000
+
+static zu_t histSum(zgckstat_t *K) {
+  zu_t s = 0;
+  for(int i = 0; i < ZZ_STAT_HIST; i++) s += K->hist[i];
+  return s;
+}
+
+void test() {
+  zgc_t *G = zNewGC(2, 256);
+  assert(G != NULL);
+  zgcstats_t st;
+  zGCGetStats(G, &st);
+  assert(st.minor.count == 0 && st.full.count == 0);
+  // Keep a list alive, and make garbages
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, i, 1);
+    t->slots[0] = zGCTopFrame(G, 0).t;
+    if(i % 4 == 0) zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+  }
+  zGCGetStats(G, &st);
+  assert(st.minor.count > 0 && st.full.count == 0);
+  assert(histSum(&st.minor) == st.minor.count);
+  assert(st.minor.max_pause_ns <= st.minor.pause_ns);
+  assert(st.minor.marked > 0 && st.minor.copied > 0);
+  assert(st.minor.promoted <= st.minor.copied);
+  assert(st.minor.gens_created > 0);
+  // A quarter of objects survive in the minor gen
+  assert(st.minor.gen_allocated[0] > 0);
+  assert(st.minor.survival[0] > 0.1 && st.minor.survival[0] < 0.5);
+  // Full GC
+  zFullGC(G);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  zFullGC(G);
+  zGCGetStats(G, &st);
+  assert(st.full.count == 2 && histSum(&st.full) == 2);
+  assert(st.full.copied >= N / 4 * 2);
+  assert(st.full.gens_deleted > 0);
+  printf("[INFO] minor: %lu GCs, %.3lfms (max %.3lfms)\n",
+    (unsigned long) st.minor.count, st.minor.pause_ns / 1e6, st.minor.max_pause_ns / 1e6);
+  printf("[INFO] full: %lu GCs, %.3lfms (max %.3lfms)\n",
+    (unsigned long) st.full.count, st.full.pause_ns / 1e6, st.full.max_pause_ns / 1e6);
+  // Hardware counters (may be unavailable)
+  const int mask = zGCSetPerfCounters(G, 1);
+  assert(mask >= 0 && mask < (1 << ZZ_PERF_N));
+  zGCResetStats(G);
+  zFullGC(G);
+  zGCGetStats(G, &st);
+  for(int i = 0; i < ZZ_PERF_N; i++) {
+    const uint64_t v = st.full.perf[ZZ_EV_GC][i];
+    if(!((mask >> i) & 1)) assert(v == 0);
+    else if(i == ZZ_PERF_CYCLES || i == ZZ_PERF_INSTRUCTIONS) assert(v > 0);
+    assert(st.full.perf[ZZ_EV_MARK][i] <= v);
+    printf("[INFO] perf %s: %lu\n", zGCPerfName(i), (unsigned long) v);
+  }
+  assert(zGCSetPerfCounters(G, 0) == 0);
+  // Reset
+  zGCResetStats(G);
+  zGCGetStats(G, &st);
+  assert(st.minor.count == 0 && st.full.count == 0 && st.full.copied == 0);
+  zDelGC(G);
+}
@@ -0,0 +1,93 @@
+#include "test.h"
+const char *TEST_NAME = "23. GC events and trace";
+
+#define N 20000
+
+typedef struct {
+  int depth, n_gc, n_events, bad;
+  int open[8];
+  uint64_t last_ts;
+  zu_t copied;
+} rec_t;
+
+static void hook(zgc_t *G, const zgcevent_t *e, zp_t ud) {
+  rec_t *r = (rec_t*) ud;
+  r->n_events++;
+  if(e->ts < r->last_ts) r->bad++;
+  r->last_ts = e->ts;
+  if(e->kind < 0 || e->kind >= 8) {
+    r->bad++;
+    return;
+  }
+  if(e->begin) {
+    // Phases are nested in a collection
+    if((e->kind == ZZ_EV_GC) != (r->depth == 0)) r->bad++;
+    r->open[e->kind]++;
+    r->depth++;
+  } else {
+    if(r->open[e->kind] != 1) r->bad++;
+    r->open[e->kind]--;
+    r->depth--;
+    if(e->kind == ZZ_EV_GC) r->n_gc++;
+    if(e->kind == ZZ_EV_COPY) r->copied += e->work;
+  }
+}
+
+static void run(zgc_t *G) {
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, i, 1);
+    t->slots[0] = zGCTopFrame(G, 0).t;
+    if(i % 4 == 0) zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+  }
+  zFullGC(G);
+}
+
+static int count(const char *s, const char *w) {
+  int n = 0;
+  for(s = strstr(s, w); s; s = strstr(s + 1, w)) n++;
+  return n;
+}
+
+void test() {
+  zgc_t *G = zNewGC(2, 256);
+  assert(G != NULL);
+  assert(strcmp(zGCEventName(ZZ_EV_MARK), "mark") == 0);
+  assert(strcmp(zGCEventName(100), "unknown") == 0);
+  // Hook
+  rec_t r;
+  memset(&r, 0, sizeof(r));
+  zGCSetHook(G, hook, &r);
+  run(G);
+  zGCSetHook(G, NULL, NULL);
+  zgcstats_t st;
+  zGCGetStats(G, &st);
+  assert(r.bad == 0 && r.depth == 0);
+  assert(r.n_gc == (int) (st.minor.count + st.full.count));
+  assert(r.copied == st.minor.copied + st.full.copied);
+  // 7 phases, begin & end
+  assert(r.n_events == r.n_gc * 14);
+  // Hook is removed
+  const int n = r.n_events;
+  zFullGC(G);
+  assert(r.n_events == n);
+  // Trace
+  FILE *fp = tmpfile();
+  assert(fp != NULL);
+  zGCTraceJSON(G, fp);
+  run(G);
+  zGCTraceEnd(G);
+  long len = ftell(fp);
+  char *s = malloc(len + 1);
+  rewind(fp);
+  assert(fread(s, 1, len, fp) == (size_t) len);
+  s[len] = 0;
+  fclose(fp);
+  assert(s[0] == '[' && strcmp(s + len - 4, "}\n]\n") == 0);
+  const int nb = count(s, "\"ph\":\"B\""), ne = count(s, "\"ph\":\"E\"");
+  assert(nb == ne && nb > 0 && nb % 7 == 0);
+  assert(count(s, "\"name\":\"gc\"") == nb / 7 * 2);
+  printf("[INFO] %d trace events\n", nb + ne);
+  free(s);
+  zDelGC(G);
+}
@@ -0,0 +1,92 @@
+#include "test.h"
+const char *TEST_NAME = "24. Allocation sampling";
+
+#define N 200000
+#define MEAN 256
+
+#define SITE_KEEP 1
+#define SITE_TEMP 2
+
+typedef struct {
+  zu_t n, w, an, aw;
+} line_t;
+
+static void readProfile(zgc_t *G, int kind, line_t *keep, line_t *temp) {
+  // Parse the profile, whose stacks are site ids
+  FILE *fp = tmpfile();
+  char buf[256];
+  assert(fp != NULL);
+  assert(zGCWriteAllocProfile(G, fp, kind) == 0);
+  rewind(fp);
+  assert(fgets(buf, sizeof(buf), fp) != NULL);
+  assert(strncmp(buf, "heap profile: ", 14) == 0);
+  assert(strstr(buf, "@ heap_v2/") != NULL);
+  memset(keep, 0, sizeof(line_t));
+  memset(temp, 0, sizeof(line_t));
+  while(fgets(buf, sizeof(buf), fp) && buf[0] != '\n') {
+    unsigned long n, w, an, aw, site;
+    assert(sscanf(buf, "%lu: %lu [%lu: %lu] @ 0x%lx",
+      &n, &w, &an, &aw, &site) == 5);
+    line_t *l = site == SITE_KEEP ? keep : temp;
+    assert(site == SITE_KEEP || site == SITE_TEMP);
+    l->n = n, l->w = w, l->an = an, l->aw = aw;
+  }
+  assert(fgets(buf, sizeof(buf), fp) != NULL);
+  assert(strcmp(buf, "MAPPED_LIBRARIES:\n") == 0);
+  fclose(fp);
+}
+
+void test() {
+  zgc_t *G = zNewGC(2, 4096);
+  assert(G != NULL);
+  line_t k, t;
+  // Disabled
+  for(int i = 0; i < 1000; i++) zAllocTup(G, i, 1);
+  readProfile(G, ZZ_PROF_ALLOC, &k, &t);
+  assert(k.an == 0 && t.an == 0);
+  // Half of the objects are kept (in a list), and the others are garbages
+  zGCSetAllocSampling(G, MEAN);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(zu_t i = 0; i < N; i++) {
+    zGCSetAllocSite(G, i & 1 ? SITE_KEEP : SITE_TEMP);
+    ztup_t *x = zAllocTup(G, i, 1);
+    if(i & 1) {
+      x->slots[0] = zGCTopFrame(G, 0).t;
+      zGCSetTopFrame(G, 0, (ztag_t) {.t = x}, 0);
+    } else x->slots[0] = NULL;
+  }
+  zGCSetAllocSampling(G, 0);
+  zRunGC(G);
+  readProfile(G, ZZ_PROF_ALLOC, &k, &t);
+  // Sampled ~ (N * 2 words) / MEAN
+  const zu_t expected = N * 2 / MEAN;
+  printf("[INFO] samples: %lu / %lu (expected %lu)\n",
+    (unsigned long) k.an, (unsigned long) t.an, (unsigned long) expected / 2);
+  assert(k.an + t.an > expected * 8 / 10 && k.an + t.an < expected * 12 / 10);
+  assert(k.aw == k.an * 2 * sizeof(zu_t));
+  // Kept objects are promoted, and temporary ones are not
+  readProfile(G, ZZ_PROF_PROMOTED, &k, &t);
+  assert(k.n == k.an && t.n == 0);
+  readProfile(G, ZZ_PROF_LIVE, &k, &t);
+  assert(k.n == k.an && t.n == 0);
+  // Drop the list: promoted and collected objects are premature
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  zFullGC(G);
+  readProfile(G, ZZ_PROF_PREMATURE, &k, &t);
+  assert(k.n == k.an && t.n == 0);
+  readProfile(G, ZZ_PROF_LIVE, &k, &t);
+  assert(k.n == 0 && t.n == 0);
+  // Reset
+  zGCResetAllocProfile(G);
+  readProfile(G, ZZ_PROF_ALLOC, &k, &t);
+  assert(k.an == 0 && t.an == 0);
+  // Backtraces
+  zGCSetAllocSite(G, 0);
+  zGCSetAllocSampling(G, 16);
+  for(int i = 0; i < 1000; i++) zAllocTup(G, i, 1);
+  FILE *fp = tmpfile();
+  assert(zGCWriteAllocProfile(G, fp, ZZ_PROF_ALLOC) == 0);
+  assert(ftell(fp) > 0);
+  fclose(fp);
+  zDelGC(G);
+}
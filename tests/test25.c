@@ -0,0 +1,94 @@
+#include "test.h"
+const char *TEST_NAME = "25. Heap dump";
+
+#define N 1000
+
+static zu_t readNum(FILE *f) {
+  zu_t v = 0;
+  int c, sh = 0;
+  do {
+    c = fgetc(f);
+    assert(c != EOF);
+    v |= (zu_t) (c & 0x7f) << sh;
+    sh += 7;
+  } while(c & 0x80);
+  return v;
+}
+
+static void countEvents(zgc_t *G, const zgcevent_t *ev, zp_t ud) {
+  ++*(int*) ud;
+}
+
+void test() {
+  zgc_t *G = zNewGC(4, 512);
+  assert(G != NULL);
+  // A list of N tuples, each has a tag and a string
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, 100 + i % 3, 2);
+    t->slots[0] = zGCTopFrame(G, 0).t;
+    t->slots[1] = NULL;
+    zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+    zstr_t *s = zIntern(G, "x", 1);
+    zGCTopFrame(G, 0).t->slots[1] = (ztup_t*) s;
+    zAllocTup(G, 7, 3); // garbage
+  }
+  // Pinned object with an immediate and a reference
+  ztup_t *pin = (ztup_t*) zAllocPinned(G, 1, 2);
+  pin->tag.u = 200;
+  pin->slots[0] = zInt(3);
+  pin->slots[1] = zGCTopFrame(G, 0).p;
+  zGCPin(G, pin);
+  zGCSetTopFrame(G, 1, (ztag_t) {.p = zInt(1)}, 0);
+  FILE *fp = tmpfile();
+  // Dump is not a collection: no events
+  int n_events = 0;
+  zGCSetHook(G, countEvents, &n_events);
+  assert(zGCHeapDump(G, fp) == 0);
+  zGCSetHook(G, NULL, NULL);
+  assert(n_events == 0);
+  rewind(fp);
+  char magic[4];
+  assert(fread(magic, 1, 4, fp) == 4 && memcmp(magic, "ZZHD", 4) == 0);
+  assert(fgetc(fp) == ZZ_DUMP_VERSION && fgetc(fp) == ZZ_SZPTR);
+  int c, n_roots = 0, n_obj = 0, n_tag[3] = {0}, n_str = 0, n_pin = 0;
+  zu_t n_refs = 0;
+  while((c = fgetc(fp)) != 'E') {
+    assert(c == 'R' || c == 'O');
+    if(c == 'R') {
+      assert(!zIsImm(readNum(fp)));
+      n_roots++;
+      continue;
+    }
+    n_obj++;
+    readNum(fp); // addr
+    zu_t gen = readNum(fp), flags = readNum(fp), size = readNum(fp);
+    zu_t tag = readNum(fp);
+    unsigned char layout[8];
+    assert(size <= 64 && fread(layout, 1, (size + 7) / 8, fp) == (size + 7) / 8);
+    zu_t n = readNum(fp);
+    for(zu_t k = 0; k < n; k++) readNum(fp);
+    n_refs += n;
+    if(flags & ZZ_DUMP_STR) n_str++;
+    else if(flags & ZZ_DUMP_PINNED) {
+      assert(gen == 0 && tag == 200 && size == 3 && layout[0] == 6 && n == 1);
+      n_pin++;
+    } else {
+      // Tuples of the list
+      assert(tag >= 100 && tag < 103 && size == 3 && layout[0] == 6);
+      n_tag[tag - 100]++;
+    }
+  }
+  fclose(fp);
+  // Roots: the list and the pinned object
+  assert(n_roots == 2);
+  // Garbages are not dumped, and interned strings are merged
+  assert(n_obj == N + 2 && n_str == 1 && n_pin == 1);
+  assert(n_tag[0] + n_tag[1] + n_tag[2] == N && n_tag[0] == (N + 2) / 3);
+  // Next pointers, strings, and a reference of the pinned object
+  assert(n_refs == (N - 1) + N + 1);
+  // GC works after dump
+  zFullGC(G);
+  assert(zGCAllocatedSlots(G, -1) >= N * 3);
+  zDelGC(G);
+}
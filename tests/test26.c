@@ -0,0 +1,93 @@
+#include "test.h"
+const char *TEST_NAME = "26. Allocation trace and replay";
+
+#define N 5000
+
+static void workload(zgc_t *G) {
+  // A list built by recorded stores, with garbage
+  zGCPushFrame(G, 2);
+  zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, i, 2);
+    zGCSetRef(G, t, 1, zGCTopFrame(G, 0).p);
+    zGCSetRef(G, t, 2, zInt(i));
+    zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+    zAllocTup(G, 7, 3); // garbage
+    if(i % 1000 == 0) zGCReserve(G, 64);
+  }
+  // Pinned object, referred by a bottom root
+  ztup_t *pin = (ztup_t*) zAllocPinned(G, 1, 1);
+  zGCPin(G, pin);
+  zGCSetBotFrame(G, 0, (ztag_t) {.t = pin}, 0);
+  zGCSetRef(G, pin, 1, zGCTopFrame(G, 0).p);
+  zGCSetTopFrame(G, 1, (ztag_t) {.u = 42}, 1);
+  zRunGC(G);
+  zGCPopFrame(G);
+  zGCUnpin(G, pin);
+  zFullGC(G);
+}
+
+void test() {
+  zgcstats_t st1, st2;
+  FILE *fp = tmpfile();
+  zgc_t *G = zNewGC(4, 1024);
+  assert(G != NULL);
+  assert(zGCRecordAllocs(G, fp) == 0);
+  assert(zGCRecordAllocs(G, fp) == -1);
+  workload(G);
+  assert(zGCRecordEnd(G) == 0);
+  assert(zGCRecordEnd(G) == -1);
+  zGCGetStats(G, &st1);
+  const zu_t live = zGCAllocatedSlots(G, -1);
+  zDelGC(G);
+  // The list (N * 3 words) is alive after full GC
+  assert(live >= N * 3);
+  // Replay with the same options
+  rewind(fp);
+  G = zNewGC(4, 1024);
+  assert(zGCReplay(G, fp) == 0);
+  zGCGetStats(G, &st2);
+  assert(st1.minor.count == st2.minor.count);
+  assert(st1.full.count == st2.full.count);
+  assert(st1.minor.promoted == st2.minor.promoted);
+  assert(zGCAllocatedSlots(G, -1) == live);
+  // The bottom root is the pinned object, which refers the list
+  ztup_t *pin = zGCBotFrame(G, 0).t;
+  assert(pin != NULL && pin->slots[0] != NULL);
+  assert(pin->slots[0]->slots[0] != NULL);
+  zDelGC(G);
+  // Replay with another minor heap size
+  rewind(fp);
+  G = zNewGC(4, 1 << 16);
+  assert(zGCReplay(G, fp) == 0);
+  zGCGetStats(G, &st2);
+  assert(st2.minor.count < st1.minor.count);
+  assert(zGCAllocatedSlots(G, -1) == live);
+  zDelGC(G);
+  // Bad input
+  rewind(fp);
+  fputc('X', fp);
+  rewind(fp);
+  G = zNewGC(4, 1024);
+  assert(zGCReplay(G, fp) == -1);
+  zDelGC(G);
+  fclose(fp);
+  // Stores out of objects and empty objects are malformed
+  // (A pair of refs, and a store into its slot 1 or 2)
+  static const unsigned char ops[][8] = {
+    {'A', 2, 3, 'W', 0, 1, 0, 'E'}, {'A', 2, 3, 'W', 0, 2, 0, 'E'},
+    {'A', 0, 'E'}};
+  for(int i = 0; i < 3; i++) {
+    fp = tmpfile();
+    fwrite("ZZTR", 1, 4, fp);
+    fputc(ZZ_TRACE_VERSION, fp);
+    fputc(ZZ_SZPTR, fp);
+    fputc(0, fp), fputc(0, fp); // roots, cyclic
+    fwrite(ops[i], 1, i < 2 ? 8 : 3, fp);
+    rewind(fp);
+    G = zNewGC(4, 1024);
+    assert(zGCReplay(G, fp) == (i == 0 ? 0 : -1));
+    zDelGC(G);
+    fclose(fp);
+  }
+}
@@ -0,0 +1,60 @@
+#include "test.h"
+const char *TEST_NAME = "27. Adaptive heap sizing";
+
+#define N 200000
+#define LIVE 1000
+
+static void churn(zgc_t *G, zu_t n) {
+  // A rotating live set of LIVE tuples, and garbage
+  for(zu_t i = 0; i < n; i++) {
+    ztup_t *t = zAllocTup(G, i, 4);
+    for(int k = 0; k < 4; k++) t->slots[k] = NULL;
+    if(i % 8 == 0)
+      zGCSetBotFrame(G, (int) ((i / 8) % LIVE), (ztag_t) {.t = t}, 0);
+  }
+}
+
+void test() {
+  zgcstats_t st;
+  // Invalid goals
+  zgc_t *G = zNewGC(LIVE, 1024);
+  assert(G != NULL);
+  assert(zGCSetGoal(G, ZZ_GOAL_GC_FRACTION, 0) == -1);
+  assert(zGCSetGoal(G, ZZ_GOAL_GC_FRACTION, 1.5) == -1);
+  assert(zGCSetGoal(G, ZZ_GOAL_MAX_HEAP, 100) == -1);
+  assert(zGCSetGoal(G, 99, 1) == -1);
+  // Fixed policy: minor heap is never resized
+  churn(G, N);
+  zGCGetStats(G, &st);
+  assert(st.minor_resizes == 0 && zGCReservedSlots(G, 0) == 1024);
+  assert(st.gc_fraction > 0 && st.gc_fraction < 1);
+  // GC time goal: tiny minor heap spends too much time in GC, so it grows
+  assert(zGCSetGoal(G, ZZ_GOAL_GC_FRACTION, 0.01) == 0);
+  churn(G, N * 4);
+  zGCGetStats(G, &st);
+  assert(st.minor_resizes > 0 && zGCReservedSlots(G, 0) > 1024);
+  printf("[INFO] fraction goal: minor %lu words, GC fraction %.3f\n",
+    (unsigned long) zGCReservedSlots(G, 0), st.gc_fraction);
+  zDelGC(G);
+  // Heap limit: the heap stays near the limit
+  const zu_t limit = 1 << 17;
+  G = zNewGC(LIVE, 1024);
+  assert(zGCSetGoal(G, ZZ_GOAL_MAX_HEAP, (double) limit) == 0);
+  zu_t peak = 0;
+  for(int r = 0; r < 20; r++) {
+    churn(G, N / 4);
+    if(zGCReservedSlots(G, -1) > peak) peak = zGCReservedSlots(G, -1);
+  }
+  zGCGetStats(G, &st);
+  assert(zGCReservedSlots(G, 0) == limit / 8);
+  assert(st.full.count > 0);
+  printf("[INFO] heap limit %lu: peak %lu words, %lu full GCs\n",
+    (unsigned long) limit, (unsigned long) peak, (unsigned long) st.full.count);
+  assert(peak <= limit);
+  // Alive objects are kept
+  for(int i = 0; i < LIVE; i++) assert(zGCBotFrame(G, i).t->tag.u % 8 == 0);
+  // Back to the fixed policy
+  assert(zGCSetGoal(G, ZZ_GOAL_NONE, 0) == 0);
+  churn(G, N / 4);
+  zDelGC(G);
+}
@@ -0,0 +1,33 @@
+#include "test.h"
+const char *TEST_NAME = "28. Cache-aware minor heap";
+
+void test() {
+  zgc_t *D = zNewGC(4, 0);
+  const zu_t default_minor = zGCReservedSlots(D, 0);
+  zDelGC(D);
+  for(int level = 1; level <= ZZ_CACHE_LEVELS; level++) {
+    const zu_t bytes = zGCCacheBytes(level);
+    printf("[INFO] L%d: %lu bytes\n", level, (unsigned long) bytes);
+    zgc_t *G = zNewGCCache(4, level);
+    assert(G != NULL);
+    const zu_t minor = zGCReservedSlots(G, 0);
+    // Minor heap with its stats and marks fits in a half of the cache, or
+    // the default size is used for unknown caches
+    const zu_t fit = bytes / 2 / (sizeof(zu_t) + 2);
+    if(fit > 16) assert(minor == fit);
+    else assert(minor == default_minor);
+    // Allocation across GCs
+    zGCSetTopFrame(G, 0, (ztag_t) {.p = NULL}, 0);
+    for(zu_t i = 0; i < minor * 2; i++) {
+      ztup_t *t = zAllocTup(G, i, 1);
+      t->slots[0] = zGCTopFrame(G, 0).t;
+      if(i % 16 == 0) zGCSetTopFrame(G, 0, (ztag_t) {.t = t}, 0);
+    }
+    assert(zGCTopFrame(G, 0).t->tag.u % 16 == 0);
+    zDelGC(G);
+  }
+  assert(zGCCacheBytes(0) == 0 && zGCCacheBytes(99) == 0);
+  // Invalid levels are rejected, not read as sizes
+  assert(zNewGCCache(4, 0) == NULL && zNewGCCache(4, -1) == NULL);
+  assert(zNewGCCache(4, ZZ_CACHE_LEVELS + 1) == NULL);
+}
@@ -0,0 +1,91 @@
+#include "test.h"
+const char *TEST_NAME = "29. Generation consolidation";
+
+#define N 60
+#define LARGE 2000 // larger than the minor heap
+
+void test() {
+  for(int cyclic = 0; cyclic <= 1; cyclic++) {
+    zgcstats_t st;
+    zgc_t *G = zNewGC(N + 1, 1024);
+    assert(G != NULL);
+    if(cyclic) zAllowCyclicRefGC(G, 1);
+    // Large objects, each refers the previous one, make many major gens
+    for(zu_t i = 0; i < N; i++) {
+      zu_t *x = zAlloc(G, LARGE - 1, 1);
+      assert(x != NULL);
+      for(zu_t k = 0; k < LARGE - 1; k++) x[k] = i * k;
+      x[LARGE - 1] = i > 0 ? (zu_t) zGCBotFrame(G, i - 1).p : 0;
+      zGCSetBotFrame(G, i, (ztag_t) {.p = x}, 0);
+      // Garbage between them
+      zAllocTup(G, i, 3);
+    }
+    // Consolidation is disabled by default
+    const zu_t before = zGCNGen(G);
+    assert(before > 8);
+    zGCGetStats(G, &st);
+    assert(st.merge.count == 0 && st.merged_gens == 0);
+    // Bound the # of gens: the next minor GC merges gens
+    zSetMaxGensGC(G, 4);
+    zAllocTup(G, 0, 1)->slots[0] = NULL;
+    assert(zRunGC(G) == 0);
+    zGCGetStats(G, &st);
+    printf("[INFO] cyclic=%d: %lu -> %lu gens, %lu merged\n", cyclic,
+      (unsigned long) before, (unsigned long) zGCNGen(G),
+      (unsigned long) st.merged_gens);
+    assert(zGCNGen(G) - 1 <= 4);
+    assert(st.merged_gens > 0 && st.merge.count > 0);
+    // Objects and references are kept
+    for(zu_t i = 0; i < N; i++) {
+      zu_t *x = (zu_t*) zGCBotFrame(G, i).p;
+      for(zu_t k = 0; k < LARGE - 1; k += 97) assert(x[k] == i * k);
+      assert(x[LARGE - 1] == (i > 0 ? (zu_t) zGCBotFrame(G, i - 1).p : 0));
+    }
+    // Still works after more GCs
+    for(zu_t i = 0; i < 10000; i++) zAllocTup(G, i, 2)->slots[0] = NULL;
+    zFullGC(G);
+    assert(zGCNGen(G) - 1 <= 4);
+    zu_t *x = (zu_t*) zGCBotFrame(G, N - 1).p;
+    for(zu_t i = N - 1; i > 0; i--) x = (zu_t*) x[LARGE - 1];
+    assert(x == (zu_t*) zGCBotFrame(G, 0).p && x[LARGE - 2] == 0);
+    zDelGC(G);
+  }
+  // Ephemeron table in a gen older than merged gens: merging shifts the gen
+  {
+    zgc_t *G = zNewGC(N + 3, 1024);
+    assert(G != NULL);
+    zSetMaxGensGC(G, 0);
+    zu_t *k = zAlloc(G, 1, 0);
+    k[0] = 7;
+    zGCSetBotFrame(G, N, (ztag_t) {.p = k}, 0);
+    zu_t *v = zAlloc(G, 1, 0);
+    v[0] = 8;
+    zGCSetBotFrame(G, N + 1, (ztag_t) {.p = v}, 0);
+    zmap_t *t = zAllocEph(G, 4);
+    t = zMapPut(G, t, zGCBotFrame(G, N).p, zGCBotFrame(G, N + 1).p);
+    zGCSetBotFrame(G, N + 1, (ztag_t) {.p = t}, 0);
+    // Padding, so that the gen is not the cheapest to merge
+    zGCSetBotFrame(G, N + 2, (ztag_t) {.p = zAlloc(G, 900, 0)}, 0);
+    assert(zRunGC(G) == 0);
+    // Younger large gens, the youngest ones are the smallest
+    for(zu_t i = 0; i < 8; i++) {
+      zu_t *x = zAlloc(G, LARGE - 100 * i, 1);
+      assert(x != NULL);
+      x[0] = i;
+      x[LARGE - 100 * i - 1] = 0;
+      zGCSetBotFrame(G, i, (ztag_t) {.p = x}, 0);
+    }
+    const zu_t before = zGCNGen(G);
+    assert(before >= 9);
+    zAllowCyclicRefGC(G, 1);
+    zSetMaxGensGC(G, before - 2);
+    zAllocTup(G, 0, 1)->slots[0] = NULL;
+    assert(zRunGC(G) == 0);
+    assert(zGCNGen(G) < before);
+    t = zGCBotFrame(G, N + 1).p;
+    v = zMapGet(G, t, zGCBotFrame(G, N).p);
+    assert(t->n == 1 && v != NULL && v[0] == 8);
+    for(zu_t i = 0; i < 8; i++) assert(((zu_t*) zGCBotFrame(G, i).p)[0] == i);
+    zDelGC(G);
+  }
+}
@@ -0,0 +1,62 @@
+#include "test.h"
+const char *TEST_NAME = "30. Idle-time GC";
+
+#define MINOR 4096
+#define N 64
+
+void test() {
+  zgcstats_t st;
+  zgc_t *G = zNewGC(N, MINOR);
+  assert(G != NULL);
+  zSetMajorMinSizeGC(G, 1 << 12);
+  // Nothing to do in an empty heap
+  assert(zGCIdle(G, zGCNowNs() + 1000000000u) == 0);
+  zGCGetStats(G, &st);
+  assert(st.idle_gcs == 0 && st.minor.count == 0);
+  // Alive tuples and garbage fill a half of the minor heap
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zAllocTup(G, i, 1);
+    t->slots[0] = NULL;
+    zGCSetBotFrame(G, i, (ztag_t) {.t = t}, 0);
+    for(zu_t k = 0; k < 16; k++) zAllocTup(G, k, 1)->slots[0] = NULL;
+  }
+  assert(zGCLeftSlots(G, 0) < MINOR / 2);
+  // A passed deadline leaves the work pending
+  assert(zGCIdle(G, 0) == 1);
+  zGCGetStats(G, &st);
+  assert(st.idle_gcs == 0 && st.minor.count == 0);
+  // Enough time: the minor heap is emptied
+  assert(zGCIdle(G, zGCNowNs() + 1000000000u) == 0);
+  zGCGetStats(G, &st);
+  assert(st.idle_gcs >= 1 && st.minor.count >= 1);
+  assert(zGCLeftSlots(G, 0) == zGCReservedSlots(G, 0));
+  // Promoted garbage grows major gens, and idle time collects all
+  for(zu_t r = 0; r < 16; r++) {
+    for(zu_t k = 0; k < MINOR / 4; k++) {
+      ztup_t *t = zAllocTup(G, k, 1);
+      t->slots[0] = zGCBotFrame(G, k % N).t;
+      zGCSetBotFrame(G, k % N, (ztag_t) {.t = t}, 0);
+    }
+    assert(zRunGC(G) == 0);
+    for(zu_t i = 0; i < N; i++) {
+      // Keep only the heads alive
+      ztup_t *t = zGCBotFrame(G, i).t;
+      t->slots[0] = NULL;
+    }
+  }
+  const zu_t full = st.full.count;
+  assert(zGCIdle(G, zGCNowNs() + 1000000000u) == 0);
+  zGCGetStats(G, &st);
+  printf("[INFO] idle GCs: %lu, full: %lu, gens: %lu\n",
+    (unsigned long) st.idle_gcs, (unsigned long) st.full.count,
+    (unsigned long) zGCNGen(G));
+  assert(st.full.count > full);
+  assert(zGCAllocatedSlots(G, -1) <= N * 2);
+  for(zu_t i = 0; i < N; i++) {
+    ztup_t *t = zGCBotFrame(G, i).t;
+    assert(t != NULL && t->slots[0] == NULL);
+  }
+  // Nothing left
+  assert(zGCIdle(G, zGCNowNs() + 1000000000u) == 0);
+  zDelGC(G);
+}
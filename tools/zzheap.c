@@ -0,0 +1,363 @@
+/* zzheap.c: heap dump analyzer for zzcore
+ * author: lumiknit
+ * Usage: zzheap [-n N] [-d depth] <dump>
+ * Prints census by tag and by shape (size & pointer layout), the top N
+ * objects by retained size, and the dominator tree. (See zGCHeapDump) */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DUMP_VERSION 1
+#define DUMP_PINNED 0x01
+#define DUMP_STR 0x02
+#define DUMP_EPH 0x04
+
+typedef struct obj {
+  uint64_t addr, tag;
+  uint64_t gen, flags, size; // size in words
+  uint8_t *layout;
+  uint64_t n_refs;
+  uint64_t *refs; // addresses, and then indices
+} obj_t;
+
+typedef struct heap {
+  int wsz; // word size
+  size_t n, cap;
+  obj_t *o; // objects, o[0] is a virtual root
+  size_t n_roots, sz_roots;
+  uint64_t *roots;
+} heap_t;
+
+typedef struct census {
+  char key[80];
+  uint64_t n, bytes;
+} census_t;
+
+// -- Reading
+
+static int readNum(FILE *f, uint64_t *v) {
+  int c, sh = 0;
+  *v = 0;
+  do {
+    if((c = fgetc(f)) == EOF || sh > 63) return -1;
+    *v |= (uint64_t) (c & 0x7f) << sh;
+    sh += 7;
+  } while(c & 0x80);
+  return 0;
+}
+
+static void* grow(void *p, size_t *cap, size_t n, size_t sz) {
+  if(n < *cap) return p;
+  *cap = *cap > 0 ? *cap << 1 : 1024;
+  p = realloc(p, sz * *cap);
+  if(p == NULL) {
+    fprintf(stderr, "zzheap: out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+static int readObj(FILE *f, obj_t *o) {
+  uint64_t k;
+  if(readNum(f, &o->addr) || readNum(f, &o->gen) || readNum(f, &o->flags) ||
+    readNum(f, &o->size) || readNum(f, &o->tag)) return -1;
+  const size_t lb = (o->size + 7) / 8;
+  o->layout = (uint8_t*) malloc(lb + 1);
+  if(fread(o->layout, 1, lb, f) != lb || readNum(f, &o->n_refs)) return -1;
+  o->refs = (uint64_t*) malloc(sizeof(uint64_t) * (o->n_refs + 1));
+  for(k = 0; k < o->n_refs; k++) {
+    if(readNum(f, o->refs + k)) return -1;
+  }
+  return 0;
+}
+
+static int readDump(FILE *f, heap_t *H) {
+  char magic[4];
+  int c;
+  if(fread(magic, 1, 4, f) != 4 || memcmp(magic, "ZZHD", 4) != 0 ||
+    fgetc(f) != DUMP_VERSION || (H->wsz = fgetc(f)) == EOF) return -1;
+  // Virtual root
+  H->o = (obj_t*) grow(NULL, &H->cap, 0, sizeof(obj_t));
+  memset(H->o, 0, sizeof(obj_t));
+  H->n = 1;
+  while((c = fgetc(f)) != EOF) {
+    if(c == 'E') return 0;
+    if(c == 'R') {
+      H->roots = (uint64_t*) grow(H->roots, &H->sz_roots, H->n_roots,
+        sizeof(uint64_t));
+      if(readNum(f, H->roots + H->n_roots++)) return -1;
+    } else if(c == 'O') {
+      H->o = (obj_t*) grow(H->o, &H->cap, H->n, sizeof(obj_t));
+      if(readObj(f, H->o + H->n++)) return -1;
+    } else return -1;
+  }
+  return -1; // No end mark
+}
+
+static int cmpAddr(const void *a, const void *b) {
+  const uint64_t x = ((const obj_t*) a)->addr, y = ((const obj_t*) b)->addr;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t findObj(heap_t *H, uint64_t addr) {
+  // Index of object at addr, or 0 if not found
+  size_t l = 1, r = H->n;
+  while(l < r) {
+    const size_t m = (l + r) / 2;
+    if(H->o[m].addr == addr) return m;
+    if(H->o[m].addr < addr) l = m + 1;
+    else r = m;
+  }
+  return 0;
+}
+
+static void resolve(heap_t *H) {
+  // Replace addresses by indices (unknown ones are dropped)
+  size_t i, k, j;
+  qsort(H->o + 1, H->n - 1, sizeof(obj_t), cmpAddr);
+  for(i = 1; i < H->n; i++) {
+    obj_t * const o = H->o + i;
+    for(j = k = 0; k < o->n_refs; k++) {
+      const uint64_t x = findObj(H, o->refs[k]);
+      if(x) o->refs[j++] = x;
+    }
+    o->n_refs = j;
+  }
+  obj_t * const R = H->o;
+  R->refs = (uint64_t*) malloc(sizeof(uint64_t) * (H->n_roots + 1));
+  for(k = 0; k < H->n_roots; k++) {
+    const uint64_t x = findObj(H, H->roots[k]);
+    if(x) R->refs[R->n_refs++] = x;
+  }
+}
+
+// -- Census
+
+static int cmpCensus(const void *a, const void *b) {
+  const uint64_t x = ((const census_t*) a)->bytes;
+  const uint64_t y = ((const census_t*) b)->bytes;
+  return x > y ? -1 : x < y;
+}
+
+static void tagKey(heap_t *H, obj_t *o, char *key) {
+  if(o->flags & DUMP_STR) strcpy(key, "(str)");
+  else if(o->flags & DUMP_EPH) strcpy(key, "(eph)");
+  else if(o->layout[0] & 1) strcpy(key, "(ptr)");
+  else sprintf(key, "%" PRIu64, o->tag);
+}
+
+static void shapeKey(heap_t *H, obj_t *o, char *key) {
+  // size:layout, where 'p' is a pointer and '.' is a non-pointer
+  uint64_t k;
+  int n = sprintf(key, "%" PRIu64 ":", o->size);
+  for(k = 0; k < o->size && n < 70; k++)
+    key[n++] = (o->layout[k / 8] >> (k % 8)) & 1 ? 'p' : '.';
+  if(k < o->size) key[n++] = '~';
+  key[n] = 0;
+}
+
+static void census(heap_t *H, const char *title, int top,
+    void (*keyOf)(heap_t*, obj_t*, char*)) {
+  census_t *c = (census_t*) malloc(sizeof(census_t) * H->n);
+  size_t n = 0, i, j;
+  char key[80];
+  for(i = 1; i < H->n; i++) {
+    keyOf(H, H->o + i, key);
+    // Linear search (# of kinds is small)
+    for(j = 0; j < n && strcmp(c[j].key, key) != 0; j++);
+    if(j == n) {
+      strcpy(c[n].key, key);
+      c[n].n = c[n].bytes = 0;
+      n++;
+    }
+    c[j].n++;
+    c[j].bytes += H->o[i].size * H->wsz;
+  }
+  qsort(c, n, sizeof(census_t), cmpCensus);
+  printf("== Census by %s (%zu kinds)\n", title, n);
+  printf("%12s %14s  %s\n", "count", "bytes", title);
+  for(i = 0; i < n && (int) i < top; i++)
+    printf("%12" PRIu64 " %14" PRIu64 "  %s\n", c[i].n, c[i].bytes, c[i].key);
+  printf("\n");
+  free(c);
+}
+
+// -- Dominators
+// Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm"
+
+static size_t *po; // postorder number of each object
+static size_t *idom;
+
+static size_t intersect(size_t a, size_t b) {
+  while(a != b) {
+    while(po[a] < po[b]) a = idom[a];
+    while(po[b] < po[a]) b = idom[b];
+  }
+  return a;
+}
+
+static void dominators(heap_t *H, uint64_t *retained) {
+  const size_t n = H->n, none = (size_t) -1;
+  size_t *order = (size_t*) malloc(sizeof(size_t) * n); // postorder
+  size_t *stk = (size_t*) malloc(sizeof(size_t) * n);
+  size_t *it = (size_t*) calloc(n, sizeof(size_t));
+  size_t *n_preds = (size_t*) calloc(n + 1, sizeof(size_t));
+  size_t *preds;
+  size_t i, k, sp = 0, m = 0;
+  po = (size_t*) malloc(sizeof(size_t) * n);
+  idom = (size_t*) malloc(sizeof(size_t) * n);
+  for(i = 0; i < n; i++) po[i] = idom[i] = none;
+  // Iterative DFS from the virtual root
+  stk[sp++] = 0;
+  po[0] = 0;
+  while(sp > 0) {
+    const size_t v = stk[sp - 1];
+    if(it[v] < H->o[v].n_refs) {
+      const size_t w = H->o[v].refs[it[v]++];
+      if(po[w] == none) {
+        po[w] = 0;
+        stk[sp++] = w;
+      }
+    } else {
+      po[v] = m;
+      order[m++] = v;
+      sp--;
+  } }
+  // Predecessors (CSR)
+  for(i = 0; i < n; i++) {
+    if(po[i] == none) continue;
+    for(k = 0; k < H->o[i].n_refs; k++) n_preds[H->o[i].refs[k] + 1]++;
+  }
+  for(i = 0; i < n; i++) n_preds[i + 1] += n_preds[i];
+  preds = (size_t*) malloc(sizeof(size_t) * (n_preds[n] + 1));
+  memset(it, 0, sizeof(size_t) * n);
+  for(i = 0; i < n; i++) {
+    if(po[i] == none) continue;
+    for(k = 0; k < H->o[i].n_refs; k++) {
+      const size_t w = H->o[i].refs[k];
+      preds[n_preds[w] + it[w]++] = i;
+  } }
+  // Iterate in reverse postorder until fixed
+  int changed = 1;
+  idom[0] = 0;
+  while(changed) {
+    changed = 0;
+    for(i = m - 1; i-- > 0;) {
+      const size_t v = order[i];
+      size_t d = none;
+      for(k = n_preds[v]; k < n_preds[v + 1]; k++) {
+        const size_t p = preds[k];
+        if(idom[p] == none) continue;
+        d = d == none ? p : intersect(p, d);
+      }
+      if(d != idom[v]) {
+        idom[v] = d;
+        changed = 1;
+  } } }
+  // Retained sizes: children are before parents in postorder
+  for(i = 0; i < n; i++) retained[i] = H->o[i].size * H->wsz;
+  for(i = 0; i + 1 < m; i++) retained[idom[order[i]]] += retained[order[i]];
+  free(order), free(stk), free(it), free(n_preds), free(preds);
+}
+
+static void describe(heap_t *H, size_t i, char *buf) {
+  obj_t * const o = H->o + i;
+  char key[80];
+  tagKey(H, o, key);
+  sprintf(buf, "0x%" PRIx64 " %s%" PRIu64 " tag=%s size=%" PRIu64, o->addr,
+    o->flags & DUMP_PINNED ? "pin" : "gen", o->gen, key, o->size * H->wsz);
+}
+
+static uint64_t *ret;
+
+static int cmpRetained(const void *a, const void *b) {
+  const uint64_t x = ret[*(const size_t*) a], y = ret[*(const size_t*) b];
+  return x > y ? -1 : x < y;
+}
+
+static void printTree(heap_t *H, size_t *kids, size_t *n_kids, size_t v,
+    int depth, int max_depth, int top) {
+  char buf[160];
+  size_t k;
+  for(k = n_kids[v]; k < n_kids[v + 1] && (int) (k - n_kids[v]) < top; k++) {
+    const size_t w = kids[k];
+    describe(H, w, buf);
+    printf("%*s%14" PRIu64 "  %s\n", depth * 2, "", ret[w], buf);
+    if(depth + 1 < max_depth)
+      printTree(H, kids, n_kids, w, depth + 1, max_depth, top);
+  }
+  if(n_kids[v + 1] - n_kids[v] > (size_t) top)
+    printf("%*s%14s  (%zu more)\n", depth * 2, "", "...",
+      n_kids[v + 1] - n_kids[v] - top);
+}
+
+static void report(heap_t *H, int top, int max_depth) {
+  const size_t n = H->n;
+  size_t i, k;
+  char buf[160];
+  ret = (uint64_t*) malloc(sizeof(uint64_t) * n);
+  dominators(H, ret);
+  // Top objects by retained size
+  size_t *ix = (size_t*) malloc(sizeof(size_t) * n), m = 0;
+  for(i = 1; i < n; i++) if(idom[i] != (size_t) -1) ix[m++] = i;
+  qsort(ix, m, sizeof(size_t), cmpRetained);
+  printf("== Top %d objects by retained size (%zu reachable, %" PRIu64
+    " bytes)\n", top, m, ret[0]);
+  printf("%14s  %s\n", "retained", "object");
+  for(i = 0; i < m && (int) i < top; i++) {
+    describe(H, ix[i], buf);
+    printf("%14" PRIu64 "  %s\n", ret[ix[i]], buf);
+  }
+  printf("\n");
+  // Dominator tree, children sorted by retained size
+  size_t *n_kids = (size_t*) calloc(n + 1, sizeof(size_t));
+  size_t *kids = (size_t*) malloc(sizeof(size_t) * (m + 1));
+  for(i = 0; i < m; i++) n_kids[idom[ix[i]] + 1]++;
+  for(i = 0; i < n; i++) n_kids[i + 1] += n_kids[i];
+  size_t *fill = (size_t*) calloc(n, sizeof(size_t));
+  for(i = 0; i < m; i++) {
+    k = idom[ix[i]];
+    kids[n_kids[k] + fill[k]++] = ix[i];
+  }
+  printf("== Dominator tree (depth %d)\n", max_depth);
+  printf("%14s  %s\n", "retained", "object");
+  printTree(H, kids, n_kids, 0, 0, max_depth, top);
+  free(ix), free(kids), free(n_kids), free(fill);
+  free(ret), free(po), free(idom);
+}
+
+int main(int argc, char **argv) {
+  int top = 20, depth = 3, i;
+  const char *path = NULL;
+  heap_t H;
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) top = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+    else path = argv[i];
+  }
+  if(path == NULL) {
+    fprintf(stderr, "Usage: %s [-n N] [-d depth] <dump>\n", argv[0]);
+    return 1;
+  }
+  FILE *f = fopen(path, "rb");
+  if(f == NULL) {
+    perror(path);
+    return 1;
+  }
+  memset(&H, 0, sizeof(H));
+  if(readDump(f, &H) < 0) {
+    fprintf(stderr, "zzheap: invalid dump: %s\n", path);
+    return 1;
+  }
+  fclose(f);
+  resolve(&H);
+  printf("%zu objects, %zu roots, %d-byte words\n\n",
+    H.n - 1, H.n_roots, H.wsz);
+  census(&H, "tag", top, tagKey);
+  census(&H, "shape", top, shapeKey);
+  report(&H, top, depth);
+  return 0;
+}
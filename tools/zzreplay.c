@@ -0,0 +1,106 @@
+/* zzreplay.c: allocation trace replayer for zzcore
+ * author: lumiknit
+ * Usage: zzreplay [-m minor] [-M major_min] [-c] <trace>
+ * Replays a trace recorded by zGCRecordAllocs with the given GC options, and
+ * prints a JSON line of GC statistics. (-c allows cyclic references) */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../zzcore.h"
+
+static zu_t peak_words = 0;
+
+static void hook(zgc_t *G, const zgcevent_t *e, zp_t ud) {
+  // Peak heap size is measured before each collection
+  if(e->kind == ZZ_EV_GC && e->begin) {
+    const zu_t w = zGCReservedSlots(G, -1);
+    if(w > peak_words) peak_words = w;
+  }
+}
+
+static int readNum(FILE *f, uint64_t *v) {
+  int c, sh = 0;
+  *v = 0;
+  do {
+    if((c = fgetc(f)) == EOF || sh > 63) return -1;
+    *v |= (uint64_t) (c & 0x7f) << sh;
+    sh += 7;
+  } while(c & 0x80);
+  return 0;
+}
+
+static int readRoots(FILE *f, uint64_t *roots) {
+  // Bottom frame size in the header
+  char magic[4];
+  if(fread(magic, 1, 4, f) != 4 || memcmp(magic, "ZZTR", 4) != 0 ||
+    fgetc(f) != ZZ_TRACE_VERSION || fgetc(f) != ZZ_SZPTR) return -1;
+  return readNum(f, roots);
+}
+
+int main(int argc, char **argv) {
+  zu_t minor = 1 << 16, major = 0;
+  int cyclic = 0, i;
+  const char *path = NULL;
+  uint64_t roots;
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+      minor = (zu_t) strtoull(argv[++i], NULL, 0);
+    else if(strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+      major = (zu_t) strtoull(argv[++i], NULL, 0);
+    else if(strcmp(argv[i], "-c") == 0) cyclic = 1;
+    else path = argv[i];
+  }
+  if(path == NULL) {
+    fprintf(stderr, "Usage: %s [-m minor] [-M major_min] [-c] <trace>\n",
+      argv[0]);
+    return 1;
+  }
+  FILE *f = fopen(path, "rb");
+  if(f == NULL) {
+    perror(path);
+    return 1;
+  }
+  if(readRoots(f, &roots) < 0) {
+    fprintf(stderr, "zzreplay: invalid trace: %s\n", path);
+    return 1;
+  }
+  rewind(f);
+  zgc_t *G = zNewGC((zu_t) roots, minor);
+  if(G == NULL) {
+    fprintf(stderr, "zzreplay: failed to create GC\n");
+    return 1;
+  }
+  if(major > 0) zSetMajorMinSizeGC(G, major);
+  if(cyclic) zAllowCyclicRefGC(G, 1);
+  zGCSetHook(G, hook, NULL);
+  const clock_t t0 = clock();
+  const int r = zGCReplay(G, f);
+  const double secs = (double) (clock() - t0) / CLOCKS_PER_SEC;
+  fclose(f);
+  if(r < 0) {
+    fprintf(stderr, "zzreplay: replay failed: %s\n", path);
+    return 1;
+  }
+  zgcstats_t st;
+  zGCGetStats(G, &st);
+  if(zGCReservedSlots(G, -1) > peak_words) peak_words = zGCReservedSlots(G, -1);
+  printf("{\"minor_heap\":%lu,\"major_min\":%lu,\"secs\":%.6f,"
+    "\"minor_gcs\":%lu,\"full_gcs\":%lu,\"gc_secs\":%.6f,"
+    "\"max_pause_ms\":%.3f,\"promoted_words\":%lu,\"copied_words\":%lu,"
+    "\"peak_heap_words\":%lu,\"final_heap_words\":%lu}\n",
+    (unsigned long) minor, (unsigned long) major, secs,
+    (unsigned long) st.minor.count, (unsigned long) st.full.count,
+    (st.minor.pause_ns + st.full.pause_ns) * 1e-9,
+    (st.minor.max_pause_ns > st.full.max_pause_ns ?
+      st.minor.max_pause_ns : st.full.max_pause_ns) * 1e-6,
+    (unsigned long) (st.minor.promoted + st.full.promoted),
+    (unsigned long) (st.minor.copied + st.full.copied),
+    (unsigned long) peak_words, (unsigned long) zGCReservedSlots(G, -1));
+  zGCSetHook(G, NULL, NULL);
+  zDelGC(G);
+  return 0;
+}
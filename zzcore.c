@@ -5,9 +5,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "zzcore.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ZZ_HAS_MMAP 1
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define ZZ_HAS_BACKTRACE 1
+#endif
+
+#if defined(__linux__) && defined(ZZ_HAS_MMAP)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define ZZ_HAS_PERF 1
+#endif
+
 /* ** ZZGC Description (Rough)
  *  ZZGC is a generational mark-and-copy GC. It has multiple generations, which
  * are one minor gen and multiple major gen. Every new object should be
@@ -58,6 +79,46 @@ const static zu_t ZZ_NEW_HEAP_SIZE_FACTOR = 3; // 3
 // Heap empty limit inv
 // : If (heap total size) / limit > allocated, remove empty gens after copy.
 const static zu_t ZZ_HEAP_EMPTY_LIMIT_INV = 5; // 20%
+// Generation consolidation
+// : When the max # of major gens is set, after a minor GC, two adjacent
+// major gens are merged if less than 1 / inv of them is allocated. If there
+// are more major gens than the max, the adjacent ones with the fewest
+// allocated words are merged.
+const static zu_t ZZ_SPARSE_GENS_INV = 4; // 25%
+const static int ZZ_DEFAULT_MAX_GENS = 0; // disabled
+// Cache share of minor heap
+// : A cache-aware minor heap (zNewGCCache) uses 1 / share of the cache,
+// including stats and marks, and leaves the rest for the mutator.
+const static zu_t ZZ_CACHE_MINOR_SHARE = 2; // 50%
+// Default pinned heap size in words
+const static zu_t ZZ_DEFAULT_PIN_HEAP_SIZE = 1 << 16; // 64k words
+// External memory limit in bytes
+// : If external memory exceeds the limit, run full GC. After full GC, the limit
+// is set to (external memory * factor), but not less than the minimum.
+const static zu_t ZZ_EXT_MIN_LIMIT = 1 << 26; // 64MB
+const static zu_t ZZ_EXT_LIMIT_FACTOR = 2;
+// Ergonomics (see zGCSetGoal)
+// : Range of minor heap size and new heap size factor chosen by the
+// controller, and the weight of the last collection in the GC time fraction.
+const static zu_t ZZ_ADAPT_MINOR_MIN = 1 << 12; // 4k words
+const static zu_t ZZ_ADAPT_MINOR_MAX = 1 << 24; // 16M words
+const static double ZZ_ADAPT_FACTOR_MIN = 1.25;
+const static double ZZ_ADAPT_FACTOR_MAX = 8;
+const static double ZZ_ADAPT_WEIGHT = 0.25;
+// Idle-time GC (see zGCIdle)
+// : In idle time, minor GC runs if 1 / inv of the minor heap is allocated,
+// and full GC runs if major gens grew by 1 / inv of the room between alive
+// words after the last full GC and the next full GC. (the trigger of the
+// goal, or twice of alive words, but at least major heap min size)
+const static zu_t ZZ_IDLE_MINOR_INV = 4; // 25%
+const static zu_t ZZ_IDLE_FULL_INV = 2; // 50%
+
+typedef struct zarena { // reserved range of heap for compressed references
+  zu_t *base;
+  zu_t size; // # of words
+  zu_t sz_ext, n_ext;
+  zu_t *ext; // free extents, pairs of (offset, size) sorted by offset
+} zarena_t;
 
 typedef struct zgen { // generation structure
   zu_t size; // # of words in data
@@ -67,8 +128,14 @@ typedef struct zgen { // generation structure
   zu_t *p; // value/pointer pools
   // Only for GC
   zu_t n_reachables; // # of words in alive objects
-  // memory pool for marks and pointers, m ++ p
+  // Only for pinned gen
+  zu_t n_free; // # of free words
+  zu_t rover; // where the search of free blocks begins (next-fit)
+  // memory pool for pointers, marks and stats, p ++ m ++ s
+  // (p comes first to be aligned, because low bits of pointers are tags)
   zb_t *body;
+  zarena_t *arena; // arena containing body, or NULL if malloc-ed
+  zu_t n_body; // # of words of body in arena
 } zgen_t;
 
 typedef struct zframe { // root stack frame
@@ -79,25 +146,142 @@ typedef struct zframe { // root stack frame
   zp_t p[1]; // memory pool
 } zframe_t;
 
+typedef struct zidh { // identity hash entry
+  zp_t p; // object
+  zu_t h; // hash
+} zidh_t;
+
+typedef struct zstab { // string table, whose entries are (string, hash)
+  zu_t sz, n;
+  zidh_t *e;
+} zstab_t;
+
+typedef struct zshape { // registered object layout
+  zu_t size; // # of words
+  zu_t n_ptr; // # of pointer words
+  zb_t *s; // stats template
+} zshape_t;
+
+#define ZZ_PROF_DEPTH 16 // max depth of backtraces of allocation sites
+
+typedef struct zsite { // allocation site of sampled objects
+  zu_t h; // hash of stack
+  int depth;
+  zp_t stk[ZZ_PROF_DEPTH];
+  zu_t n[4], words[4]; // # of samples & their words for each ZZ_PROF_*
+} zsite_t;
+
+typedef struct zsample { // sampled object
+  zp_t p;
+  int site;
+  int state; // 0: in minor gen, 1: promoted, 2: allocated in major gen
+  zu_t words;
+} zsample_t;
+
+typedef struct ztrace { // allocation trace in recording or replaying
+  FILE *f;
+  int replay;
+  zu_t next_id; // id of the next allocated object
+  // Alive objects: hash table (address -> id) in recording, or array sorted
+  // by ids in replaying
+  zu_t sz, n;
+  zidh_t *e;
+} ztrace_t;
+
+typedef struct zfin { // finalizer entry
+  zp_t p; // object
+  zfinalizer_t fn;
+  zp_t ud; // user data
+} zfin_t;
+
 typedef struct zgc {
   // -- Options
   zu_t major_heap_min_size; // [1-] Major heap minimum size
+  int max_gens; // max # of major gens, 0 for no consolidation
   int has_cyclic_ref; // true when there are cyclic references
+  // -- Sizing policy, which is fixed unless a goal is set
+  double heap_factor; // new heap size factor
+  zu_t empty_limit_inv; // heap empty limit inv
+  int goal; // ZZ_GOAL_*
+  double goal_value;
+  zu_t minor_target; // minor heap size to resize after GC, 0 to keep
+  zu_t major_trigger; // run full GC if major words exceed it, 0 for never
+  uint64_t gc_end; // end time of the last collection
+  // -- Idle-time GC
+  double idle_rate[2]; // estimated pause ns per word of minor & full GC
+  zu_t idle_live; // major words after the last full GC
   // -- Generations
   int sz_gens, n_gens; // Gens array size & number of gens
   zgen_t **gens;
+  // -- Pinned (non-moving) gens
+  int sz_pins, n_pins;
+  zgen_t **pins;
   // -- Roots
   zframe_t *bot_frame, *top_frame;
+  // -- Arena (only for compressed references)
+  zarena_t *arena;
+  // -- Shapes
+  int sz_shapes, n_shapes;
+  zshape_t *shapes;
+  // -- External memory & finalizers
+  zu_t ext_bytes; // # of bytes of external memory
+  zu_t ext_minor; // # of bytes added after the last collection
+  zu_t ext_limit; // Run full GC if ext_bytes exceeds this
+  // -- Pinned allocation trigger
+  zu_t pin_alloc; // # of pinned words allocated after the last full GC
+  zu_t pin_limit; // Run full GC before a new pinned gen if pin_alloc exceeds
+  zu_t sz_fins, n_fins;
+  zfin_t *fins;
+  // -- Reservation
+  zu_t reserve_lim; // Reserved while minor->left > reserve_lim
+  zu_t reserve_minor; // minor heap size before enlarged by reservation, or 0
+  // -- Identity hash table
+  zu_t sz_idh, n_idh, n_idt; // n_idt: # of tombstones
+  zidh_t *idh;
+  // -- String tables
+  zstab_t syms; // interned strings
+  int str_dedup; // true when string deduplication is enabled
+  zstab_t dds; // canonical strings for deduplication (in major gens)
   // --- GC data
   // mark stack
   zi_t mark_sp, sz_mark_stk;
   zp_t *mark_stk;
+  // alive ephemeron tables found in marking, pairs of (gen, idx)
+  zu_t sz_ephs, n_ephs;
+  zu_t *ephs;
   // GC Temp: used during collection
   int gc_target; // collection target generation
   int mark_top; // max marking generation + 1
   int move_top; // max move generation + 1
+  int mark_all; // true when all gens are marked
+  int gc_merge; // true when consolidating gens into a new gen at move_top
   // -- statistics
   zu_t n_collection;
+  zgcstats_t stats;
+  zgckstat_t *kstat; // stats of the running collection
+  uint64_t gc_start; // start time of the running collection
+  zu_t gc_copied; // copied words before the running collection
+  zu_t gc_words; // allocated words of the collected gens, 0 if unknown
+  // -- Event hook
+  zgchook_t hook;
+  zp_t hook_ud;
+  // -- Hardware counters
+  int perf_on;
+  int perf_fd[ZZ_PERF_N]; // -1 if not opened
+  uint64_t perf_at[ZZ_PERF_PHASES][ZZ_PERF_N]; // values at phase beginnings
+  // -- Allocation sampling
+  zu_t smp_mean; // mean interval in words, 0 if disabled
+  zu_t smp_left; // # of words until the next sample
+  uint64_t smp_rand; // random state
+  zu_t smp_site; // user site id, 0 to use backtraces
+  zu_t sz_smps, n_smps;
+  zsample_t *smps;
+  int sz_sites, n_sites;
+  zsite_t *sites;
+  zu_t sz_site_idx; // hash index of sites, -1 for empty
+  int *site_idx;
+  // -- Allocation trace
+  ztrace_t *trace;
 } zgc_t;
 
 // Mark constant
@@ -110,19 +294,111 @@ typedef struct zgc {
 // Stat constant
 #define ZZ_NPTR 0x01 // Not-pointer flag
 #define ZZ_SEP 0x02 // Chunk separator flag
+#define ZZ_FREE 0x04 // Free word flag (only for pinned gens)
+#define ZZ_WEAK 0x08 // Weak pointer flag
+#define ZZ_EPH 0x10 // Ephemeron table flag (at the first word of object)
+#define ZZ_STR 0x20 // String flag (at the first word of object)
+#define ZZ_CREF 0x40 // Compressed references flag (with ZZ_NPTR)
+
+// Arena: Gens of a compressed GC are allocated in a reserved range, thus
+// a reference is a 32-bit offset in words from the base.
+// (Offset 0 is never used, which is NULL)
+static zarena_t* zNewArena(zu_t sz) {
+#ifdef ZZ_HAS_MMAP
+  zarena_t *A = (zarena_t*) malloc(sizeof(zarena_t));
+  zu_t *ext = (zu_t*) malloc(sizeof(zu_t) * 2 * 16);
+  void *b = mmap(NULL, sizeof(zu_t) * sz, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(A == NULL || ext == NULL || b == MAP_FAILED) {
+    free(A);
+    free(ext);
+    if(b != MAP_FAILED) munmap(b, sizeof(zu_t) * sz);
+    return NULL;
+  }
+  A->base = (zu_t*) b;
+  A->size = sz;
+  A->sz_ext = 16, A->n_ext = 1;
+  A->ext = ext;
+  ext[0] = 1, ext[1] = sz - 1;
+  return A;
+#else
+  return NULL;
+#endif
+}
 
-static zgen_t* zNewGen(zu_t sz) {
+static void zDelArena(zarena_t *A) {
+#ifdef ZZ_HAS_MMAP
+  munmap(A->base, sizeof(zu_t) * A->size);
+#endif
+  free(A->ext);
+  free(A);
+}
+
+static zu_t* zArenaAlloc(zarena_t *A, zu_t words) {
+  // First fit
+  zu_t i;
+  for(i = 0; i < A->n_ext; i++) {
+    zu_t * const e = A->ext + 2 * i;
+    if(e[1] >= words) {
+      zu_t * const p = A->base + e[0];
+      e[0] += words, e[1] -= words;
+      if(e[1] == 0) {
+        memmove(e, e + 2, sizeof(zu_t) * 2 * (A->n_ext - i - 1));
+        A->n_ext--;
+      }
+      return p;
+  } }
+  return NULL;
+}
+
+static void zArenaFree(zarena_t *A, zu_t *p, zu_t words) {
+  zu_t off = p - A->base, i;
+#ifdef ZZ_HAS_MMAP
+  // Return pages to OS
+  const zu_t pg = (zu_t) sysconf(_SC_PAGESIZE);
+  const zu_t pb = ((zu_t) p + pg - 1) / pg * pg;
+  const zu_t pe = (zu_t) (p + words) / pg * pg;
+  if(pb < pe) madvise((void*) pb, pe - pb, MADV_DONTNEED);
+#endif
+  for(i = 0; i < A->n_ext && A->ext[2 * i] < off; i++);
+  // Merge with neighbors
+  if(i > 0 && A->ext[2 * i - 2] + A->ext[2 * i - 1] == off) {
+    i--;
+    A->ext[2 * i + 1] += words;
+  } else {
+    if(A->n_ext >= A->sz_ext) {
+      zu_t * const ext = (zu_t*) realloc(A->ext, sizeof(zu_t) * 4 * A->sz_ext);
+      if(ext == NULL) return; // Leak the range
+      A->ext = ext, A->sz_ext <<= 1;
+    }
+    memmove(A->ext + 2 * i + 2, A->ext + 2 * i,
+      sizeof(zu_t) * 2 * (A->n_ext - i));
+    A->ext[2 * i] = off, A->ext[2 * i + 1] = words;
+    A->n_ext++;
+  }
+  if(i + 1 < A->n_ext &&
+      A->ext[2 * i] + A->ext[2 * i + 1] == A->ext[2 * i + 2]) {
+    A->ext[2 * i + 1] += A->ext[2 * i + 3];
+    memmove(A->ext + 2 * i + 2, A->ext + 2 * i + 4,
+      sizeof(zu_t) * 2 * (A->n_ext - i - 2));
+    A->n_ext--;
+} }
+
+static zgen_t* zNewGen(zarena_t *A, zu_t sz) {
   zgen_t *X = (zgen_t*) malloc(sizeof(zgen_t));
   zu_t alloc_sz = (sizeof(zu_t) + sizeof(zb_t) * 2) * (sz + 1);
-  zu_t *b = (zu_t*) malloc(alloc_sz);
-  memset(b, 0x00, (sizeof(zb_t) * 2) * (sz + 1));
+  const zu_t n_body = zBytesToWords(alloc_sz);
+  zu_t *b = A ? zArenaAlloc(A, n_body) : (zu_t*) malloc(alloc_sz);
   if(X == NULL || b == NULL) goto L_fail;
   X->size = X->left = sz;
   X->body = (zp_t) b;
+  X->arena = A;
+  X->n_body = n_body;
   X->n_reachables = 0;
-  X->m = (zb_t*) b;
-  X->s = (zb_t*) (X->m + (sz + 1));
-  X->p = (zu_t*) (X->m + (sz + 1) * 2);
+  X->p = b;
+  X->m = (zb_t*) (b + (sz + 1));
+  X->s = X->m + (sz + 1);
+  memset(X->m, 0x00, (sizeof(zb_t) * 2) * (sz + 1));
   // end of array mark
   X->m[X->size] = ZZ_COLOR;
   X->s[X->size] = ZZ_SEP;
@@ -130,11 +406,16 @@ static zgen_t* zNewGen(zu_t sz) {
   X->p[X->size] = 0xFA15E;
   return X;
 L_fail:
+  if(X) free(X);
+  // Return the reserved range to the arena, as zDelGen
+  if(b && A) zArenaFree(A, b, n_body);
+  else if(b) free(b);
   return NULL;
 }
 
 static void zDelGen(zgen_t *X) {
-  free(X->body);
+  if(X->arena) zArenaFree(X->arena, (zu_t*) X->body, X->n_body);
+  else free(X->body);
   free(X);
 }
 
@@ -166,78 +447,607 @@ static void zGenCleanAll(zgen_t *X) {
 
 static zi_t zGenPtrIdx(zgen_t *X, zp_t p) {
   // Check p is in X and return index of p if so
+  if(zIsImm(p)) return -1;
   const zu_t px = ((zu_t) p - (zu_t) X->p) / sizeof(zp_t);
   return px >= X->size || px < X->left ? -1 : px;
 }
 
+/* Pinned gen is a non-moving generation for objects which should not move.
+ * (e.g. buffers for I/O) Unlike normal gens, it allocates objects in free
+ * blocks (next-fit, from the end of the last allocation, and from the
+ * beginning after each sweep) and frees dead objects in place
+ * (mark-and-sweep). Every
+ * free word is marked as ZZ_FREE, and `left` is always 0. Each object has a
+ * header word (pin count), and the pin count is a separated chunk right
+ * before the object. */
+static zgen_t* zNewPinGen(zarena_t *A, zu_t sz) {
+  zgen_t *X = zNewGen(A, sz);
+  if(X == NULL) return NULL;
+  memset(X->s, ZZ_FREE | ZZ_NPTR | ZZ_SEP, sizeof(zb_t) * sz);
+  X->left = 0;
+  X->n_free = sz;
+  X->rover = 0;
+  return X;
+}
+
+static zu_t* zPinGenAlloc(zgen_t *X, zu_t np, zu_t p) {
+  const zu_t sz = 1 + np + p; // including header
+  zu_t off, run = 0;
+  if(X->n_free < sz) return NULL;
+  // Find the next free block from the rover, or from the beginning
+  for(off = X->rover; off < X->size; off++) {
+    if(!(X->s[off] & ZZ_FREE)) run = 0;
+    else if(++run >= sz) break;
+  }
+  if(off >= X->size && X->rover > 0) {
+    for(off = 0, run = 0; off < X->size; off++) {
+      if(!(X->s[off] & ZZ_FREE)) run = 0;
+      else if(++run >= sz) break;
+  } }
+  if(off >= X->size) return NULL;
+  X->rover = off + 1;
+  off -= sz - 1;
+  X->n_free -= sz;
+  // Header (pin count)
+  X->s[off] = ZZ_NPTR | ZZ_SEP;
+  X->p[off++] = 0;
+  // Object
+  memset(X->s + off, ZZ_NPTR, sizeof(zb_t) * np);
+  memset(X->s + off + np, 0x00, sizeof(zb_t) * p);
+  X->s[off] |= ZZ_SEP;
+  memset(X->p + off, 0x00, sizeof(zu_t) * (np + p));
+  return X->p + off;
+}
+
+static void zPinGenSweep(zgen_t *X) {
+  // Free all white and unpinned objects
+  zu_t off = 0, end;
+  while(off < X->size) {
+    if(X->s[off] & ZZ_FREE) {
+      off++;
+      continue;
+    }
+    // off is a header and (off + 1) is an object
+    for(end = off + 2; !(X->s[end] & ZZ_SEP); end++);
+    if(X->m[off + 1] == ZZ_WHITE && X->p[off] == 0) {
+      memset(X->s + off, ZZ_FREE | ZZ_NPTR | ZZ_SEP, sizeof(zb_t) * (end - off));
+      X->n_free += end - off;
+    }
+    off = end;
+  }
+  X->rover = 0;
+  zGenCleanMarks(X);
+}
+
+static zgen_t* zFindPin(zgc_t *G, zp_t ptr, zi_t *idx) {
+  // Return pinned gen & idx of ptr, or NULL if ptr is not a pinned object
+  int k;
+  for(k = 0; k < G->n_pins; k++) {
+    zgen_t * const K = G->pins[k];
+    const zi_t i = zGenPtrIdx(K, ptr);
+    if(i >= 0) {
+      if(i == 0 || (K->s[i] & (ZZ_SEP | ZZ_FREE)) != ZZ_SEP ||
+          (K->s[i - 1] & (ZZ_SEP | ZZ_FREE)) != ZZ_SEP) return NULL;
+      *idx = i;
+      return K;
+  } }
+  return NULL;
+}
+
+static zb_t* zStatOf(zgc_t *G, zp_t ptr) {
+  // Return stats of the object ptr, or NULL if ptr is not in the heap
+  int k;
+  for(k = 0; k < G->n_gens; k++) {
+    const zi_t idx = zGenPtrIdx(G->gens[k], ptr);
+    if(idx >= 0) return G->gens[k]->s + idx;
+  }
+  for(k = 0; k < G->n_pins; k++) {
+    const zi_t idx = zGenPtrIdx(G->pins[k], ptr);
+    if(idx >= 0) return G->pins[k]->s + idx;
+  }
+  return NULL;
+}
+
+static zu_t* zPinHeader(zgc_t *G, zp_t ptr) {
+  // Return pin count header of ptr, or NULL if ptr is not a pinned object
+  zi_t idx;
+  zgen_t *K = zFindPin(G, ptr, &idx);
+  return K ? K->p + idx - 1 : NULL;
+}
+
+static uint64_t zNowNs(void) {
+  // Monotonic time in ns
+#ifdef ZZ_HAS_MMAP
+  struct timespec ts;
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+  return (uint64_t) clock() * (1000000000u / CLOCKS_PER_SEC);
+}
+
 static zframe_t* zNewFrame(int sz, zframe_t *prev) {
   zu_t asz = sizeof(zframe_t) + (sizeof(zp_t) + sizeof(zb_t)) * sz;
   zframe_t *f = (zframe_t*) malloc(asz);
   memset(f, 0x00, asz);
   f->size = sz;
   f->prev = prev;
-  f->s = (zb_t*) (f + 1);
-  f->v = (ztag_t*) (f->s + sz);
+  f->v = (ztag_t*) (f + 1);
+  f->s = (zb_t*) (f->v + sz);
   return f;
 }
 
 // GC APIs
-zgc_t* zNewGC(zu_t sz_roots, zu_t sz_minor) {
+// Cache topology
+zu_t zGCCacheBytes(int level) {
+  // Read cpu0 caches from sysfs, skipping instruction caches
+  zu_t bytes = 0;
+#ifdef __linux__
+  char path[96], type[32], unit;
+  unsigned long sz;
+  int i, lv;
+  FILE *f;
+  for(i = 0; i < 16 && bytes == 0; i++) {
+    const char * const dir = "/sys/devices/system/cpu/cpu0/cache/index";
+    snprintf(path, sizeof(path), "%s%d/level", dir, i);
+    if((f = fopen(path, "r")) == NULL) break;
+    if(fscanf(f, "%d", &lv) != 1) lv = -1;
+    fclose(f);
+    if(lv != level) continue;
+    snprintf(path, sizeof(path), "%s%d/type", dir, i);
+    if((f = fopen(path, "r")) == NULL) continue;
+    if(fscanf(f, "%31s", type) != 1) type[0] = '\0';
+    fclose(f);
+    if(strcmp(type, "Data") && strcmp(type, "Unified")) continue;
+    snprintf(path, sizeof(path), "%s%d/size", dir, i);
+    if((f = fopen(path, "r")) == NULL) continue;
+    switch(fscanf(f, "%lu%c", &sz, &unit)) {
+    case 1: bytes = sz; break;
+    case 2:
+      bytes = unit == 'K' ? (zu_t) sz << 10 : unit == 'M' ? (zu_t) sz << 20 :
+        unit == 'G' ? (zu_t) sz << 30 : sz;
+      break;
+    }
+    fclose(f);
+  }
+#else
+  (void) level;
+#endif
+  return bytes;
+}
+
+static zu_t zCacheMinorSize(int level) {
+  // Words of minor heap fitting in the cache, or 0 if unknown
+  const zu_t bytes = zGCCacheBytes(level) / ZZ_CACHE_MINOR_SHARE;
+  return bytes / (sizeof(zu_t) + sizeof(zb_t) * 2);
+}
+
+static zgc_t* zNewGCIn(zu_t sz_roots, zu_t sz_minor, zarena_t *A) {
   zgc_t *G = (zgc_t*) malloc(sizeof(zgc_t));
   zgen_t **gens = (zgen_t**) malloc(sizeof(zgen_t*) * ZZ_N_GENS);
   zframe_t *bot_frame = zNewFrame(sz_roots, NULL);
   zp_t *stk = (zp_t*) malloc(sizeof(zp_t) * ZZ_MARK_STK_BOT_SIZE);
+  int k;
   if(sz_minor <= ZZ_HEAP_MIN_SIZE) sz_minor = ZZ_DEFAULT_MINOR_HEAP_SIZE;
-  zgen_t *minor = zNewGen(sz_minor);
+  zgen_t *minor = zNewGen(A, sz_minor);
   if(!G || !gens || !bot_frame || !stk || !minor) goto L_fail;
   memset(gens, 0x00, sizeof(zgen_t*) * ZZ_N_GENS);
   gens[0] = minor;
   G->gens = gens;
+  G->arena = A;
+  G->sz_shapes = G->n_shapes = 0;
+  G->shapes = NULL;
+  G->has_cyclic_ref = 0;
+  G->sz_pins = G->n_pins = 0;
+  G->pins = NULL;
+  G->ext_bytes = G->ext_minor = 0;
+  G->ext_limit = ZZ_EXT_MIN_LIMIT;
+  G->pin_alloc = 0;
+  G->pin_limit = ZZ_DEFAULT_PIN_HEAP_SIZE;
+  G->sz_fins = G->n_fins = 0;
+  G->fins = NULL;
+  G->reserve_lim = (zu_t) -1;
+  G->reserve_minor = 0;
+  G->sz_ephs = G->n_ephs = 0;
+  G->ephs = NULL;
+  G->sz_idh = G->n_idh = G->n_idt = 0;
+  G->idh = NULL;
+  G->syms.sz = G->syms.n = 0;
+  G->syms.e = NULL;
+  G->str_dedup = 0;
+  G->dds.sz = G->dds.n = 0;
+  G->dds.e = NULL;
   G->bot_frame = G->top_frame = bot_frame;
   G->major_heap_min_size = ZZ_DEFAULT_MAJOR_HEAP_SIZE;
+  G->max_gens = ZZ_DEFAULT_MAX_GENS;
+  G->gc_merge = 0;
+  G->heap_factor = (double) ZZ_NEW_HEAP_SIZE_FACTOR;
+  G->empty_limit_inv = ZZ_HEAP_EMPTY_LIMIT_INV;
+  G->goal = ZZ_GOAL_NONE;
+  G->goal_value = 0;
+  G->minor_target = G->major_trigger = 0;
+  G->gc_end = zNowNs();
+  G->idle_rate[0] = G->idle_rate[1] = 0;
+  G->idle_live = 0;
   G->sz_gens = ZZ_N_GENS, G->n_gens = 1;
   G->mark_stk = stk;
   stk[0] = stk[ZZ_MARK_STK_BOT_SIZE - 1] = NULL;
   G->mark_sp = 1;
   G->sz_mark_stk = ZZ_MARK_STK_BOT_SIZE;
   G->n_collection = 0;
+  zGCResetStats(G);
+  G->hook = NULL;
+  G->hook_ud = NULL;
+  G->perf_on = 0;
+  for(k = 0; k < ZZ_PERF_N; k++) G->perf_fd[k] = -1;
+  G->smp_mean = G->smp_site = 0;
+  G->smp_left = (zu_t) -1;
+  G->smp_rand = 0x9e3779b97f4a7c15u;
+  G->sz_smps = G->n_smps = 0;
+  G->smps = NULL;
+  G->sz_sites = G->n_sites = 0;
+  G->sites = NULL;
+  G->sz_site_idx = 0;
+  G->site_idx = NULL;
+  G->trace = NULL;
   return G;
 L_fail:
   if(G) free(G);
   if(gens) free(gens);
   if(bot_frame) free(bot_frame);
+  if(stk) free(stk);
+  if(minor) zDelGen(minor);
   return NULL;
 }
 
+zgc_t* zNewGC(zu_t sz_roots, zu_t sz_minor) {
+  return zNewGCIn(sz_roots, sz_minor, NULL);
+}
+
+zgc_t* zNewGCCache(zu_t sz_roots, int level) {
+  if(level < 1 || level > ZZ_CACHE_LEVELS) return NULL;
+  return zNewGCIn(sz_roots, zCacheMinorSize(level), NULL);
+}
+
+zgc_t* zNewCRefGC(zu_t sz_roots, zu_t sz_minor, zu_t sz_heap) {
+  zarena_t *A;
+  zgc_t *G;
+  // Offsets are 32-bit
+  if(sz_heap > (zu_t) 0xffffffff) sz_heap = (zu_t) 0xffffffff;
+  if((A = zNewArena(sz_heap)) == NULL) return NULL;
+  if((G = zNewGCIn(sz_roots, sz_minor, A)) == NULL) zDelArena(A);
+  return G;
+}
+
 void zDelGC(zgc_t *G) {
   int k;
   for(k = 0; k < G->n_gens; k++)
     zDelGen(G->gens[k]);
   free(G->gens);
+  for(k = 0; k < G->n_pins; k++)
+    zDelGen(G->pins[k]);
+  free(G->pins);
+  free(G->fins);
+  free(G->ephs);
+  free(G->idh);
+  free(G->syms.e);
+  free(G->dds.e);
+  free(G->smps);
+  free(G->sites);
+  free(G->site_idx);
+  if(G->trace) {
+    free(G->trace->e);
+    free(G->trace);
+  }
+  zGCSetPerfCounters(G, 0);
   zframe_t *f;
   while(G->top_frame) {
     f = G->top_frame;
     G->top_frame = f->prev;
     free(f);
   }
+  for(k = 0; k < G->n_shapes; k++) free(G->shapes[k].s);
+  free(G->shapes);
+  if(G->arena) zDelArena(G->arena);
   free(G);
 }
 
 // Option setter
+void zSetStrDedupGC(zgc_t *G, int v) {
+  G->str_dedup = v;
+}
+
 void zSetMajorMinSizeGC(zgc_t *G, zu_t msz) {
   if(msz >= ZZ_HEAP_MIN_SIZE) G->major_heap_min_size = msz;
 }
 
+void zSetMaxGensGC(zgc_t *G, int n) {
+  if(n >= 0) G->max_gens = n;
+}
+
+static zu_t zHeapWords(zgc_t *G) {
+  // Total size of gens
+  zu_t sz = 0;
+  int k;
+  for(k = 0; k < G->n_gens; k++) sz += G->gens[k]->size;
+  for(k = 0; k < G->n_pins; k++) sz += G->pins[k]->size;
+  return sz;
+}
+
+static zu_t zNewGenSize(zgc_t *G, zu_t need, zu_t min) {
+  // Size of a new gen for need words. With a heap limit, the size is cut to
+  // fit in the limit, but not less than need.
+  zu_t sz = (zu_t) (need * G->heap_factor);
+  if(sz < min) sz = min;
+  if(G->goal == ZZ_GOAL_MAX_HEAP) {
+    const zu_t limit = (zu_t) G->goal_value;
+    zu_t used = zHeapWords(G);
+    // Minor heap will be resized to the target
+    if(G->minor_target > G->gens[0]->size)
+      used += G->minor_target - G->gens[0]->size;
+    if(used + sz > limit) sz = limit > used + need ? limit - used : need;
+  }
+  return sz;
+}
+
+static int zReserveGens(zgc_t *G) {
+  // Make a room for one more gen in the gens array
+  if(G->n_gens < G->sz_gens) return 0;
+  zgen_t **gens = (zgen_t**) realloc(G->gens,
+    sizeof(zgen_t*) * (G->sz_gens << 1));
+  if(gens == NULL) return -1;
+  G->gens = gens;
+  G->sz_gens <<= 1;
+  return 0;
+}
+
+// Address hash table: open addressing (linear probing) by addresses, used
+// by identity hashes and allocation traces
+static zu_t zHashPtr(zp_t p) {
+  // Hash of address (or value) p, which is never 0
+  zu_t h = ((zu_t) p / ZZ_SZPTR) * (zu_t) 0x9e3779b97f4a7c15ull;
+  h ^= h >> (ZZ_SZPTR * 4);
+  return h ? h : 1;
+}
+
+static zidh_t* zIdHashSlot(zidh_t *t, zu_t cap, zp_t p) {
+  // Return the entry of p, or an empty entry for p
+  const zu_t mask = cap - 1;
+  zu_t i = zHashPtr(p) & mask;
+  while(t[i].p && t[i].p != p) i = (i + 1) & mask;
+  return t + i;
+}
+
+// Defined below, and used by allocation
+static int zMinorGCIn(zgc_t*);
+static int zRunGCIn(zgc_t*);
+static int zFullGCIn(zgc_t*);
+
+// Allocation trace
+// Format: "ZZTR", version(1 byte), word size(1 byte), bottom frame size,
+// cyclic flag, and then ops. Every number is an unsigned LEB128.
+// Objects are identified by ids in the allocation order, and a reference is
+// 0 for a non-pointer, 1 for NULL (or unknown), or id + 2.
+// - 'A' size layout[ceil(size / 8)]: allocation, where i-th bit of layout is
+//   set for a pointer word
+// - 'Q' np p: pinned allocation
+// - 'F' size / 'f': push / pop frame
+// - 'S' frame(0: top, 1: bottom) idx ref: set a frame slot
+// - 'W' id idx ref: pointer store by zGCSetRef
+// - 'G' / 'g': zRunGC / zFullGC
+// - 'R' words: zGCReserve
+// - 'P' bytes / 'p' bytes: add / sub external pressure
+// - 'C' v + 1: zAllowCyclicRefGC
+// - 'N' id / 'n' id: pin / unpin
+// - 'E': end
+static void zWriteNum(FILE *f, zu_t v) {
+  while(v >= 0x80) {
+    fputc((int) (v & 0x7f) | 0x80, f);
+    v >>= 7;
+  }
+  fputc((int) v, f);
+}
+
+static ztrace_t* zRecording(zgc_t *G) {
+  return G->trace && !G->trace->replay ? G->trace : NULL;
+}
+
+static void zTraceOp(zgc_t *G, int op, int n, zu_t a, zu_t b, zu_t c) {
+  // Write op with n numbers, if recording
+  ztrace_t * const T = zRecording(G);
+  if(T == NULL) return;
+  fputc(op, T->f);
+  if(n > 0) zWriteNum(T->f, a);
+  if(n > 1) zWriteNum(T->f, b);
+  if(n > 2) zWriteNum(T->f, c);
+}
+
+static zu_t zTraceRef(zgc_t *G, zp_t p, int is_nptr) {
+  // Reference to p in recording
+  ztrace_t * const T = G->trace;
+  if(is_nptr) return 0;
+  if(p == NULL || T->n == 0) return 1;
+  const zidh_t * const e = zIdHashSlot(T->e, T->sz, p);
+  return e->p ? e->h + 2 : 1;
+}
+
+static void zTraceNew(zgc_t *G, zu_t *x) {
+  // Give the next id to the new object x (NULL if failed)
+  ztrace_t * const T = G->trace;
+  zu_t k;
+  if(T->replay) {
+    // Ids are consumed even on failure, to keep following ops
+    const zu_t id = T->next_id++;
+    if(x == NULL) return;
+    if(T->n >= T->sz) {
+      const zu_t n = T->sz > 0 ? T->sz << 1 : 1024;
+      zidh_t *e = (zidh_t*) realloc(T->e, sizeof(zidh_t) * n);
+      if(e == NULL) return;
+      T->e = e, T->sz = n;
+    }
+    T->e[T->n].p = x, T->e[T->n].h = id;
+    T->n++;
+    return;
+  }
+  if(x == NULL) return;
+  if((T->n + 1) * 2 > T->sz) {
+    const zu_t cap = T->sz > 0 ? T->sz << 1 : 1024;
+    zidh_t *e = (zidh_t*) calloc(cap, sizeof(zidh_t));
+    if(e == NULL) return;
+    for(k = 0; k < T->sz; k++) {
+      if(T->e[k].p) *zIdHashSlot(e, cap, T->e[k].p) = T->e[k];
+    }
+    free(T->e);
+    T->e = e, T->sz = cap;
+  }
+  zidh_t * const e = zIdHashSlot(T->e, T->sz, x);
+  e->p = x, e->h = T->next_id++;
+  T->n++;
+}
+
+static void zTraceAlloc(zgc_t *G, zu_t *x, zu_t sz, const zb_t *s) {
+  // Record an allocation with its layout s
+  ztrace_t * const T = G->trace;
+  zu_t k;
+  // Empty objects share addresses with the next ones, so they have no ids
+  if(sz == 0) return;
+  if(!T->replay && x) {
+    zb_t b = 0;
+    fputc('A', T->f);
+    zWriteNum(T->f, sz);
+    for(k = 0; k < sz; k++) {
+      if(!(s[k] & ZZ_NPTR)) b |= 1 << (k & 7);
+      if((k & 7) == 7 || k + 1 == sz) {
+        fputc(b, T->f);
+        b = 0;
+  } } }
+  zTraceNew(G, x);
+}
+
+// Allocation sampling
+// Sampled allocations are a Poisson process on allocated words, thus the
+// interval is exponentially distributed.
+static zu_t zSampleInterval(zgc_t *G) {
+  // -ln(u) = ln2 * -log2(u), where log2 is approximated by the exponent and
+  // linear interpolation of the mantissa
+  uint64_t x = G->smp_rand;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  G->smp_rand = x;
+  const uint64_t r = (x >> 11) + 1; // u = r / 2^53 in (0, 1]
+  int e = 0;
+  while((r >> e) > 1) e++;
+  const double f = (double) (r - ((uint64_t) 1 << e)) / ((uint64_t) 1 << e);
+  const double v = 0.6931471805599453 * (53 - e - f) * G->smp_mean;
+  return v < 1 ? 1 : (zu_t) v;
+}
+
+static int zSiteIdxResize(zgc_t *G, zu_t cap) {
+  int *idx = (int*) malloc(sizeof(int) * cap);
+  zu_t k;
+  int i;
+  if(idx == NULL) return -1;
+  for(k = 0; k < cap; k++) idx[k] = -1;
+  for(i = 0; i < G->n_sites; i++) {
+    for(k = G->sites[i].h & (cap - 1); idx[k] >= 0; k = (k + 1) & (cap - 1));
+    idx[k] = i;
+  }
+  free(G->site_idx);
+  G->site_idx = idx;
+  G->sz_site_idx = cap;
+  return 0;
+}
+
+static int zFindSite(zgc_t *G, zp_t *stk, int depth) {
+  // Find or add the site of the stack. Returns -1 on failure.
+  zu_t h = (zu_t) depth, k;
+  int i;
+  for(i = 0; i < depth; i++) h = (h ^ (zu_t) stk[i]) * 0x9e3779b1u;
+  h ^= h >> 15;
+  if(G->sz_site_idx > 0) {
+    for(k = h & (G->sz_site_idx - 1); (i = G->site_idx[k]) >= 0;
+        k = (k + 1) & (G->sz_site_idx - 1)) {
+      zsite_t * const S = G->sites + i;
+      if(S->h == h && S->depth == depth &&
+          memcmp(S->stk, stk, sizeof(zp_t) * depth) == 0) return i;
+  } }
+  // New site
+  if(G->n_sites >= G->sz_sites) {
+    const int n = G->sz_sites > 0 ? G->sz_sites << 1 : 64;
+    zsite_t *sites = (zsite_t*) realloc(G->sites, sizeof(zsite_t) * n);
+    if(sites == NULL) return -1;
+    G->sites = sites, G->sz_sites = n;
+  }
+  if((zu_t) G->n_sites * 2 >= G->sz_site_idx &&
+    zSiteIdxResize(G, G->sz_site_idx > 0 ? G->sz_site_idx << 1 : 128) < 0)
+    return -1;
+  i = G->n_sites++;
+  zsite_t * const S = G->sites + i;
+  memset(S, 0x00, sizeof(zsite_t));
+  S->h = h;
+  S->depth = depth;
+  memcpy(S->stk, stk, sizeof(zp_t) * depth);
+  for(k = h & (G->sz_site_idx - 1); G->site_idx[k] >= 0;
+    k = (k + 1) & (G->sz_site_idx - 1));
+  G->site_idx[k] = i;
+  return i;
+}
+
+static void zSampleAlloc(zgc_t *G, zu_t *x, zu_t sz) {
+  // Record x as a sample
+  zp_t stk[ZZ_PROF_DEPTH];
+  int depth = 0, site, k;
+  if(G->smp_mean == 0) {
+    G->smp_left = (zu_t) -1;
+    return;
+  }
+  G->smp_left = zSampleInterval(G);
+  if(G->smp_site) stk[depth++] = (zp_t) G->smp_site;
+#ifdef ZZ_HAS_BACKTRACE
+  else depth = backtrace(stk, ZZ_PROF_DEPTH);
+#endif
+  if((site = zFindSite(G, stk, depth)) < 0) return;
+  if(G->n_smps >= G->sz_smps) {
+    const zu_t n = G->sz_smps > 0 ? G->sz_smps << 1 : 64;
+    zsample_t *smps = (zsample_t*) realloc(G->smps, sizeof(zsample_t) * n);
+    if(smps == NULL) return;
+    G->smps = smps, G->sz_smps = n;
+  }
+  zsample_t * const X = G->smps + G->n_smps++;
+  X->p = x;
+  X->site = site;
+  X->state = zGenPtrIdx(G->gens[0], x) >= 0 ? 0 : 2;
+  X->words = sz;
+  for(k = ZZ_PROF_ALLOC; k <= ZZ_PROF_LIVE; k++) {
+    G->sites[site].n[k]++;
+    G->sites[site].words[k] += sz;
+} }
+
+static zu_t* zSampled(zgc_t *G, zu_t *x, zu_t sz) {
+  // Count allocated words, and sample x if the interval is passed
+  // (Allocations are also traced here)
+  if(G->trace) zTraceAlloc(G, x, sz, x ? zStatOf(G, x) : NULL);
+  if(G->smp_left <= sz) {
+    if(x) zSampleAlloc(G, x, sz);
+  } else G->smp_left -= sz;
+  return x;
+}
+
 // Allocation
-zu_t* zAlloc(zgc_t *G, zu_t np, zu_t p) {
+static zu_t* zAllocIn(zgc_t *G, zu_t np, zu_t p) {
   const zu_t sz = np + p;
-  zgen_t * const minor = G->gens[0];
+  zgen_t *minor = G->gens[0];
+  // Make a space in minor heap, which may be resized by GC
+  if(sz < minor->size && minor->left < sz) {
+    zRunGCIn(G);
+    minor = G->gens[0];
+  }
   // Check very large chunk required
   if(sz >= minor->size) {
     int k;
     if(!G->has_cyclic_ref && p > 0) {
       // If cyclic is not allowed and there is ref part, run gc
-      if(zRunGC(G) < 0) return NULL;
+      if(zRunGCIn(G) < 0) return NULL;
       // and alloc in new generation
     } else {
       // Try to find a empty space
@@ -247,23 +1057,404 @@ zu_t* zAlloc(zgc_t *G, zu_t np, zu_t p) {
       }
     }
     // Make a new generation
-    zgen_t *J = zNewGen(sz * ZZ_NEW_HEAP_SIZE_FACTOR);
-    if(J == NULL) return NULL;
+    zgen_t *J;
+    if(zReserveGens(G) < 0 ||
+      (J = zNewGen(G->arena, zNewGenSize(G, sz, 0))) == NULL)
+      return NULL;
     for(k = G->n_gens; k >= 2; k--) {
       G->gens[k] = G->gens[k - 1];
     }
     G->gens[1] = J;
     G->n_gens++;
+    G->stats.large_gens++;
     return zGenAlloc(J, np, p);
   }
-  // Try to allocate in minor heap
-  if(minor->left < sz) zRunGC(G);
+  // Allocate in minor heap
   minor->left -= sz;
   memset(minor->s + minor->left, ZZ_NPTR, sizeof(zb_t) * np);
   minor->s[minor->left] |= ZZ_SEP;
   return minor->p + minor->left;
 }
 
+zu_t* zAlloc(zgc_t *G, zu_t np, zu_t p) {
+  return zSampled(G, zAllocIn(G, np, p), np + p);
+}
+
+int zRegisterShape(zgc_t *G, zu_t size, const zu_t *mask) {
+  // Make a stats template from the pointer mask
+  const zu_t wb = ZZ_SZPTR * 8;
+  zu_t k;
+  if(size == 0) return -1;
+  if(G->n_shapes >= G->sz_shapes) {
+    const int sz = G->sz_shapes > 0 ? G->sz_shapes << 1 : 16;
+    zshape_t *shapes = (zshape_t*) realloc(G->shapes, sizeof(zshape_t) * sz);
+    if(shapes == NULL) return -1;
+    G->shapes = shapes, G->sz_shapes = sz;
+  }
+  zshape_t * const sh = G->shapes + G->n_shapes;
+  if((sh->s = (zb_t*) malloc(sizeof(zb_t) * size)) == NULL) return -1;
+  sh->size = size, sh->n_ptr = 0;
+  for(k = 0; k < size; k++) {
+    if((mask[k / wb] >> (k % wb)) & 1) sh->s[k] = 0, sh->n_ptr++;
+    else sh->s[k] = ZZ_NPTR;
+  }
+  sh->s[0] |= ZZ_SEP;
+  return G->n_shapes++;
+}
+
+zu_t* zAllocLayout(zgc_t *G, zu_t sz, const zb_t *layout) {
+  zgen_t *minor = G->gens[0];
+  zb_t *s;
+  zu_t *x;
+  if(sz < minor->size && minor->left < sz) {
+    zRunGCIn(G);
+    minor = G->gens[0];
+  }
+  if(sz >= minor->size) {
+    // Large object: allocate as usual, and then overwrite stats
+    zu_t n_ptr = 0, k;
+    for(k = 0; k < sz; k++) n_ptr += !(layout[k] & ZZ_NPTR);
+    if((x = zAllocIn(G, sz - n_ptr, n_ptr)) == NULL)
+      return zSampled(G, NULL, sz);
+    s = zStatOf(G, x);
+  } else {
+    minor->left -= sz;
+    s = minor->s + minor->left;
+    x = minor->p + minor->left;
+  }
+  memcpy(s, layout, sizeof(zb_t) * sz);
+  s[0] |= ZZ_SEP;
+  return zSampled(G, x, sz);
+}
+
+zu_t* zAllocShape(zgc_t *G, int shape) {
+  if(shape < 0 || shape >= G->n_shapes) return NULL;
+  return zAllocLayout(G, G->shapes[shape].size, G->shapes[shape].s);
+}
+
+static zu_t* zAllocPinnedIn(zgc_t *G, zu_t np, zu_t p) {
+  int k, gc = 0;
+  zu_t *ptr;
+  if(np + p == 0) np = 1;
+L_retry:
+  for(k = 0; k < G->n_pins; k++) {
+    if((ptr = zPinGenAlloc(G->pins[k], np, p))) {
+      G->pin_alloc += 1 + np + p;
+      return ptr;
+  } }
+  // Pinned gens are swept only by full GC, so run it before growing them if
+  // many pinned words were allocated (unless reserved)
+  if(!gc && G->pin_alloc > G->pin_limit &&
+    G->gens[0]->left <= G->reserve_lim) {
+    if(zFullGCIn(G) < 0) return NULL;
+    gc = 1;
+    goto L_retry;
+  }
+  // Make a new pinned generation
+  zu_t sz = (1 + np + p) * ZZ_NEW_HEAP_SIZE_FACTOR;
+  if(sz < ZZ_DEFAULT_PIN_HEAP_SIZE) sz = ZZ_DEFAULT_PIN_HEAP_SIZE;
+  if(G->n_pins >= G->sz_pins) {
+    const int n = G->sz_pins > 0 ? G->sz_pins << 1 : ZZ_N_GENS;
+    zgen_t **pins = (zgen_t**) realloc(G->pins, sizeof(zgen_t*) * n);
+    if(pins == NULL) return NULL;
+    G->pins = pins, G->sz_pins = n;
+  }
+  zgen_t *J = zNewPinGen(G->arena, sz);
+  if(J == NULL) return NULL;
+  G->pins[G->n_pins++] = J;
+  G->pin_alloc += 1 + np + p;
+  return zPinGenAlloc(J, np, p);
+}
+
+zu_t* zAllocPinned(zgc_t *G, zu_t np, zu_t p) {
+  zu_t * const x = zAllocPinnedIn(G, np, p);
+  if(G->trace) {
+    if(x) zTraceOp(G, 'Q', 2, np, p, 0);
+    zTraceNew(G, x);
+  }
+  return x;
+}
+
+int zGCPin(zgc_t *G, zp_t ptr) {
+  zu_t *h = zPinHeader(G, ptr);
+  if(h && zRecording(G)) zTraceOp(G, 'N', 1, zTraceRef(G, ptr, 0), 0, 0);
+  return h ? (int) ++*h : -1;
+}
+
+int zGCUnpin(zgc_t *G, zp_t ptr) {
+  zu_t *h = zPinHeader(G, ptr);
+  if(h == NULL) return -1;
+  if(zRecording(G)) zTraceOp(G, 'n', 1, zTraceRef(G, ptr, 0), 0, 0);
+  if(*h > 0) --*h;
+  return (int) *h;
+}
+
+int zGCReserve(zgc_t *G, zu_t words) {
+  // Objects smaller than minor heap are always allocated in minor heap, and
+  // zAlloc runs GC only when there is no space. Thus reservation is just making
+  // enough space in minor heap.
+  // Note that other GC triggers (e.g. external memory) are suspended while
+  // reserved. Only a minor GC runs here (full GCs and merges after it are
+  // left to the next GC), to keep at most one collection.
+  int r = 1;
+  zTraceOp(G, 'R', 1, words, 0, 0);
+  if(words >= G->gens[0]->size || words > G->gens[0]->left) {
+    if(zMinorGCIn(G) < 0) return -1;
+    if(words >= G->gens[0]->size) {
+      // Minor heap is empty after GC, so replace it with a large one, until
+      // the next GC
+      zgen_t *J = zNewGen(G->arena, words + 1);
+      if(J == NULL) return -1;
+      if(G->reserve_minor == 0) G->reserve_minor = G->gens[0]->size;
+      zDelGen(G->gens[0]);
+      G->gens[0] = J;
+    }
+    r = 0;
+  }
+  G->reserve_lim = G->gens[0]->left - words;
+  return r;
+}
+
+static int zIsReserved(zgc_t *G) {
+  return G->gens[0]->left > G->reserve_lim;
+}
+
+// External memory
+int zGCAddExternalPressure(zgc_t *G, zu_t bytes) {
+  zTraceOp(G, 'P', 1, bytes, 0, 0);
+  G->ext_bytes += bytes;
+  G->ext_minor += bytes;
+  if(zIsReserved(G)) return 1;
+  // Too much external memory: old objects may hold them
+  if(G->ext_bytes > G->ext_limit) return zFullGCIn(G);
+  // External memory as much as minor heap is allocated
+  if(G->ext_minor >= zWordsToBytes(G->gens[0]->size)) {
+    // Force minor collection even if minor heap is not full
+    G->ext_minor = 0;
+    return zRunGCIn(G);
+  }
+  return 1;
+}
+
+void zGCSubExternalPressure(zgc_t *G, zu_t bytes) {
+  zTraceOp(G, 'p', 1, bytes, 0, 0);
+  G->ext_bytes = G->ext_bytes > bytes ? G->ext_bytes - bytes : 0;
+}
+
+int zGCSetFinalizer(zgc_t *G, zp_t p, zfinalizer_t fn, zp_t ud) {
+  if(G->n_fins >= G->sz_fins) {
+    const zu_t n = G->sz_fins > 0 ? G->sz_fins << 1 : ZZ_N_GENS;
+    zfin_t *fins = (zfin_t*) realloc(G->fins, sizeof(zfin_t) * n);
+    if(fins == NULL) return -1;
+    G->fins = fins, G->sz_fins = n;
+  }
+  G->fins[G->n_fins++] = (zfin_t) {p, fn, ud};
+  return 0;
+}
+
+static zu_t* zAllocKeep(zgc_t *G, zu_t np, zu_t p, zp_t *keep, int n) {
+  // Allocate an object. If GC may run, pointers in keep are rooted during
+  // allocation and updated.
+  zu_t *x;
+  int k;
+  if(n == 0 || np + p < G->gens[0]->left) return zAlloc(G, np, p);
+  zGCPushFrame(G, n);
+  for(k = 0; k < n; k++) zGCSetTopFrame(G, k, (ztag_t) {.p = keep[k]}, 0);
+  x = zAlloc(G, np, p);
+  for(k = 0; k < n; k++) keep[k] = zGCTopFrame(G, k).p;
+  zGCPopFrame(G);
+  return x;
+}
+
+static int zReserveKeep(zgc_t *G, zu_t words, zp_t *keep, int n) {
+  // Reserve words. If GC may run, pointers in keep are rooted and updated.
+  int k, r;
+  zgen_t * const minor = G->gens[0];
+  if(n == 0 || (words < minor->size && words <= minor->left))
+    return zGCReserve(G, words);
+  zGCPushFrame(G, n);
+  for(k = 0; k < n; k++) zGCSetTopFrame(G, k, (ztag_t) {.p = keep[k]}, 0);
+  r = zGCReserve(G, words);
+  for(k = 0; k < n; k++) keep[k] = zGCTopFrame(G, k).p;
+  zGCPopFrame(G);
+  return r;
+}
+
+// Identity hash: Hash of an object is its address when it is hashed first.
+// It is kept in a side table (address -> hash), which GC updates after move.
+// Entries of moved objects are re-inserted, leaving tombstones, which are
+// dropped when the table is resized.
+#define ZZ_IDH_DEAD ((zp_t) 1) // tombstone (never an object)
+
+static int zIdHashResize(zgc_t *G, zu_t cap) {
+  zidh_t *t = (zidh_t*) calloc(cap, sizeof(zidh_t));
+  zu_t i;
+  if(t == NULL) return -1;
+  for(i = 0; i < G->sz_idh; i++) {
+    const zp_t p = G->idh[i].p;
+    if(p && p != ZZ_IDH_DEAD) *zIdHashSlot(t, cap, p) = G->idh[i];
+  }
+  free(G->idh);
+  G->idh = t, G->sz_idh = cap;
+  G->n_idt = 0;
+  return 0;
+}
+
+static void zIdHashPut(zgc_t *G, zp_t p, zu_t h) {
+  // Put p, which is not in the table, into an empty entry or a tombstone
+  const zu_t mask = G->sz_idh - 1;
+  zu_t i = zHashPtr(p) & mask;
+  while(G->idh[i].p && G->idh[i].p != ZZ_IDH_DEAD) i = (i + 1) & mask;
+  if(G->idh[i].p) G->n_idt--;
+  G->idh[i].p = p;
+  G->idh[i].h = h;
+  G->n_idh++;
+}
+
+static zu_t zIdHash(zgc_t *G, zp_t p, int assign) {
+  // Return identity hash of p. If p is an object without hash, assign a new
+  // hash only when assign is true. (Otherwise, return 0)
+  zidh_t *e;
+  // (Immediate values may look like the tombstone)
+  if(zIsImm(p)) return zHashPtr(p);
+  if(G->n_idh > 0) {
+    e = zIdHashSlot(G->idh, G->sz_idh, p);
+    if(e->p) return e->h;
+  }
+  // Non-object values are hashed by their values
+  if(zStatOf(G, p) == NULL) return zHashPtr(p);
+  if(!assign) return 0;
+  // Grow for alive entries, or just drop tombstones
+  if((G->n_idh + G->n_idt + 1) * 2 > G->sz_idh &&
+    zIdHashResize(G, G->sz_idh == 0 ? 64 : (G->n_idh + 1) * 4 > G->sz_idh ?
+      G->sz_idh << 1 : G->sz_idh) < 0) return 0;
+  zIdHashPut(G, p, zHashPtr(p));
+  return zHashPtr(p);
+}
+
+// String table: open addressing (linear probing) by string hashes.
+// Strings are weakly held, and GC removes collected strings.
+static zu_t zHashBytes(const char *c, zu_t len) {
+  // FNV-1a, which is never 0
+  zu_t h = (zu_t) 0xcbf29ce484222325ull, i;
+  for(i = 0; i < len; i++) {
+    h ^= (zb_t) c[i];
+    h *= (zu_t) 0x100000001b3ull;
+  }
+  return h ? h : 1;
+}
+
+static zu_t zStabFind(zstab_t *T, const char *c, zu_t len, zu_t h) {
+  // Return index of the string, or index of an empty entry for it
+  const zu_t mask = T->sz - 1;
+  zu_t i = h & mask;
+  for(; T->e[i].h; i = (i + 1) & mask) {
+    const zstr_t * const x = (zstr_t*) T->e[i].p;
+    if(T->e[i].h == h && x->len == len && !memcmp(x->c, c, len)) break;
+  }
+  return i;
+}
+
+static int zStabResize(zstab_t *T, zu_t cap) {
+  zidh_t *t = (zidh_t*) calloc(cap, sizeof(zidh_t));
+  zu_t i, j;
+  if(t == NULL) return -1;
+  for(i = 0; i < T->sz; i++) {
+    if(T->e[i].h) {
+      for(j = T->e[i].h & (cap - 1); t[j].h; j = (j + 1) & (cap - 1));
+      t[j] = T->e[i];
+  } }
+  free(T->e);
+  T->e = t, T->sz = cap;
+  return 0;
+}
+
+static int zStabPut(zstab_t *T, zstr_t *s, zu_t h) {
+  // Put s, replacing the string of the same contents
+  zu_t i;
+  if((T->n + 1) * 2 > T->sz &&
+    zStabResize(T, T->sz > 0 ? T->sz << 1 : 64) < 0) return -1;
+  i = zStabFind(T, s->c, s->len, h);
+  if(T->e[i].h == 0) T->n++;
+  T->e[i].p = s, T->e[i].h = h;
+  return 0;
+}
+
+static void zStabDelAt(zstab_t *T, zu_t i) {
+  // Delete i-th entry by shifting following entries backward
+  const zu_t mask = T->sz - 1;
+  zu_t j = i, h;
+  T->n--;
+  for(;;) {
+    T->e[i].p = NULL, T->e[i].h = 0;
+    do {
+      j = (j + 1) & mask;
+      if(T->e[j].h == 0) return;
+      h = T->e[j].h & mask;
+      // Keep j if its home h is cyclically in (i, j]
+    } while(i <= j ? (i < h && h <= j) : (i < h || h <= j));
+    T->e[i] = T->e[j];
+    i = j;
+} }
+
+// Map: open addressing (linear probing) with stored identity hashes.
+// Because hashes are stable, maps are not rehashed after GC.
+static zu_t zMapFind(zmap_t *m, zp_t key, zu_t h) {
+  // Return index of key, or index of an empty slot for key
+  const zu_t mask = m->cap - 1;
+  zp_t * const kv = zMapKV(m);
+  zu_t i = h & mask;
+  while(m->hk[i] && (m->hk[i] != h || kv[i << 1] != key)) i = (i + 1) & mask;
+  return i;
+}
+
+static void zMapDelAt(zmap_t *m, zu_t i) {
+  // Delete i-th entry by shifting following entries backward
+  const zu_t mask = m->cap - 1;
+  zp_t * const kv = zMapKV(m);
+  zu_t j = i, h;
+  for(;;) {
+    m->hk[i] = 0;
+    kv[i << 1] = kv[(i << 1) + 1] = NULL;
+    do {
+      j = (j + 1) & mask;
+      if(m->hk[j] == 0) return;
+      h = m->hk[j] & mask;
+      // Keep j if its home h is cyclically in (i, j]
+    } while(i <= j ? (i < h && h <= j) : (i < h || h <= j));
+    m->hk[i] = m->hk[j];
+    kv[i << 1] = kv[j << 1];
+    kv[(i << 1) + 1] = kv[(j << 1) + 1];
+    i = j;
+} }
+
+static void zMapSweep(zmap_t *m) {
+  // Remove entries whose keys or values are cleared by GC
+  zp_t * const kv = zMapKV(m);
+  zu_t i;
+  for(i = 0; i < m->cap; i++) {
+    while(m->hk[i] && !(kv[i << 1] && kv[(i << 1) + 1])) {
+      zMapDelAt(m, i);
+      m->n--;
+} } }
+
+static zmap_t* zNewMap(zgc_t *G, zu_t cap, int eph, zp_t *keep, int n) {
+  // Allocate an empty map. Ephemeron table has weak key/value slots.
+  // Capacity is rounded up to a power of 2.
+  zu_t c = 4, k;
+  while(c < cap) c <<= 1;
+  zmap_t *m = (zmap_t*) zAllocKeep(G, 2 + c, c * 2, keep, n);
+  if(m == NULL) return NULL;
+  m->n = 0, m->cap = c;
+  memset(m->hk, 0x00, sizeof(zu_t) * c * 3);
+  if(eph) {
+    zb_t * const s = zStatOf(G, m);
+    for(k = 2 + c; k < 2 + c * 3; k++) s[k] |= ZZ_WEAK;
+    s[0] |= ZZ_EPH;
+  }
+  return m;
+}
+
 // Collection
 
 // Mark stack API
@@ -294,8 +1485,8 @@ static int zMarkStkPop(zgc_t *G, int *gen, zu_t *idx) {
     G->mark_sp = G->sz_mark_stk - 1;
   }
   G->mark_sp -= 2;
-  *idx = (int) (zi_t) G->mark_stk[G->mark_sp + 1];
-  *gen = (zu_t) G->mark_stk[G->mark_sp];
+  *idx = (zu_t) G->mark_stk[G->mark_sp + 1];
+  *gen = (int) (zi_t) G->mark_stk[G->mark_sp];
   return 1;
 }
 static void zMarkStkClean(zgc_t *G) {
@@ -313,58 +1504,188 @@ static void zMarkStkClean(zgc_t *G) {
   G->mark_sp = 1;
 }
 
+static int zMarkRef(zgc_t *G, zp_t ref, int kf) {
+  // Find generation & index of ref. If ref is white, mark it and push.
+  // (Pinned gens are pushed with negative gen, -1 - (idx of pinned gen))
+  // Return 1 if ref is newly marked.
+  int k;
+  for(k = kf; k < G->mark_top; k++) {
+    zgen_t * const K = G->gens[k];
+    const zi_t idy = zGenPtrIdx(K, ref);
+    if(idy >= 0) {
+      // Check ref is not visited
+      if((K->s[idy] & ZZ_SEP) && (K->m[idy] == ZZ_WHITE)) {
+        // Mark black
+        // (For incremental GC, it should be ZZ_GRAY)
+        K->m[idy] = ZZ_BLACK;
+        zMarkStkPush(G, k, idy);
+        return 1;
+      }
+      return 0;
+  } }
+  for(k = 0; k < G->n_pins; k++) {
+    zgen_t * const K = G->pins[k];
+    const zi_t idy = zGenPtrIdx(K, ref);
+    if(idy >= 0) {
+      if((K->s[idy] & (ZZ_SEP | ZZ_FREE)) == ZZ_SEP &&
+          (K->m[idy] == ZZ_WHITE)) {
+        K->m[idy] = ZZ_BLACK;
+        zMarkStkPush(G, -1 - k, idy);
+        return 1;
+      }
+      return 0;
+  } }
+  return 0;
+}
+
+static void zMarkRecordEph(zgc_t *G, int gen, zu_t idx) {
+  // Record an alive ephemeron table
+  if(G->n_ephs >= G->sz_ephs) {
+    const zu_t n = G->sz_ephs > 0 ? G->sz_ephs << 1 : ZZ_N_GENS;
+    zu_t *ephs = (zu_t*) realloc(G->ephs, sizeof(zu_t) * 2 * n);
+    if(ephs == NULL) return;
+    G->ephs = ephs, G->sz_ephs = n;
+  }
+  G->ephs[G->n_ephs << 1] = (zu_t) (zi_t) gen;
+  G->ephs[(G->n_ephs << 1) + 1] = idx;
+  G->n_ephs++;
+}
+
 static int zMarkPropagate(zgc_t *G, int gen, zu_t idx) {
   // Propagation of marking in black
-  zgen_t * const J = G->gens[gen];
+  zgen_t * const J = gen >= 0 ? G->gens[gen] : G->pins[-1 - gen];
   // Traverse all references from p
+  // (Pinned objects may refer any generation)
   zu_t xoff = idx;
-  const zu_t kf = G->has_cyclic_ref ? 0 : gen;
+  const int kf = G->has_cyclic_ref || gen < 0 ? 0 : gen;
+  if(J->s[idx] & ZZ_EPH) zMarkRecordEph(G, gen, idx);
   do {
-    if(!(J->s[xoff] & ZZ_NPTR)) { // Ignore non-pointer slots
-      // Find generation & index of ref
-      const zp_t ref = (zp_t) J->p[xoff];
-      zu_t k;
-      for(k = kf; k < G->mark_top; k++) {
-        zgen_t * const K = G->gens[k];
-        const zi_t idy = zGenPtrIdx(K, ref);
-        // Check ref is not visited
-        if(idy >= 0 && (K->s[idy] & ZZ_SEP) &&
-            (K->m[idy] == ZZ_WHITE)) {
-          // Mark black
-          // (For incremental GC, it should be ZZ_GRAY)
-          K->m[idy] = ZZ_BLACK;
-          zMarkStkPush(G, k, idy);
-          break;
-    } } }
+    // Ignore non-pointer, weak slots and immediate values
+    if(J->s[xoff] & ZZ_CREF) {
+      const uint32_t * const r = (uint32_t*) (J->p + xoff);
+      if(r[0]) zMarkRef(G, G->arena->base + r[0], kf);
+      if(r[1]) zMarkRef(G, G->arena->base + r[1], kf);
+    } else if(!(J->s[xoff] & (ZZ_NPTR | ZZ_WEAK)) && !zIsImm(J->p[xoff])) {
+      zMarkRef(G, (zp_t) J->p[xoff], kf);
+    }
   } while(!(J->s[++xoff] & ZZ_SEP));
   J->n_reachables += xoff - idx;
   return 0;
 }
 
+static void zMarkDrain(zgc_t *G) {
+  // Propagate until the mark stack is empty
+  int gen;
+  zu_t idx;
+  while(zMarkStkPop(G, &gen, &idx)) {
+    zMarkPropagate(G, gen, idx);
+} }
+
+static int zIsMarked(zgc_t *G, zp_t ref) {
+  // Return 0 only if ref is a white object in marked gens
+  int k;
+  for(k = 0; k < G->mark_top; k++) {
+    const zi_t idy = zGenPtrIdx(G->gens[k], ref);
+    if(idy >= 0) return G->gens[k]->m[idy] != ZZ_WHITE;
+  }
+  for(k = 0; k < G->n_pins; k++) {
+    const zi_t idy = zGenPtrIdx(G->pins[k], ref);
+    if(idy >= 0) return G->pins[k]->m[idy] != ZZ_WHITE;
+  }
+  return 1;
+}
+
+static zmap_t* zEphAt(zgc_t *G, zu_t i) {
+  // Return i-th ephemeron table found in marking
+  const int gen = (int) (zi_t) G->ephs[i << 1];
+  zgen_t * const J = gen >= 0 ? G->gens[gen] : G->pins[-1 - gen];
+  return (zmap_t*) (J->p + G->ephs[(i << 1) + 1]);
+}
+
+static void zMarkEphemerons(zgc_t *G) {
+  // Mark values of ephemerons whose keys are alive, until no more marked.
+  // (Marking values may find new alive keys or tables.)
+  zu_t i, j;
+  int marked;
+  do {
+    marked = 0;
+    for(i = 0; i < G->n_ephs; i++) {
+      zmap_t * const t = zEphAt(G, i);
+      zp_t * const kv = zMapKV(t);
+      for(j = 0; j < t->cap; j++) {
+        const zp_t key = kv[j << 1], val = kv[(j << 1) + 1];
+        if(key && val && zIsMarked(G, key) && zMarkRef(G, val, 0)) {
+          zMarkDrain(G);
+          marked = 1;
+  } } } } while(marked);
+}
+
+static void zPerfGC(zgc_t *G, int kind, int begin) {
+  // Accumulate hardware counters of the phase into the running stats
+#ifdef ZZ_HAS_PERF
+  int i;
+  uint64_t v;
+  for(i = 0; i < ZZ_PERF_N; i++) {
+    if(G->perf_fd[i] < 0 ||
+      read(G->perf_fd[i], &v, sizeof(v)) != (ssize_t) sizeof(v)) continue;
+    if(begin) G->perf_at[kind][i] = v;
+    else G->kstat->perf[kind][i] += v - G->perf_at[kind][i];
+  }
+#endif
+}
+
+static void zEventGC(zgc_t *G, int kind, int begin, zu_t work) {
+  // Read counters, and call the hook, if exists
+  if(G->perf_on) zPerfGC(G, kind, begin);
+  if(G->hook == NULL) return;
+  zgcevent_t e;
+  e.kind = kind;
+  e.begin = begin;
+  e.full = G->kstat == &G->stats.full;
+  e.ts = zNowNs();
+  e.work = work;
+  G->hook(G, &e, G->hook_ud);
+}
+
 static int zMarkGC(zgc_t *G) {
   // Push all roots into stack
   zframe_t *f;
-  int j, k;
-  int gen;
-  zu_t idx;
+  int k;
+  zu_t off;
+  const zu_t marked = G->kstat->marked;
+  zEventGC(G, ZZ_EV_MARK, 1, 0);
+  G->mark_all = G->mark_top >= G->n_gens;
+  G->n_ephs = 0;
   // Traverse root frames
   for(f = G->top_frame; f; f = f->prev) {
     for(k = 0; k < f->size; k++) {
-      if(!(f->s[k] & ZZ_NPTR)) {
-        // Pick pointer and find generation & index
-        for(j = 0; j < G->mark_top; j++) {
-          zgen_t * const J = G->gens[j];
-          const zi_t idy = zGenPtrIdx(J, f->v[k].p);
-          if(idy >= 0 && (J->s[idy] & ZZ_SEP) &&
-            (J->m[idy] == ZZ_WHITE)) {
-            // If object is white, mark black and prop
-            J->m[idy] = ZZ_BLACK;
-            zMarkPropagate(G, j, idy);
-            while(zMarkStkPop(G, &gen, &idx)) {
-              zMarkPropagate(G, gen, idx);
-  } } } } } }
+      if(!(f->s[k] & ZZ_NPTR) && !zIsImm(f->v[k].u)) {
+        zMarkRef(G, f->v[k].p, 0);
+        zMarkDrain(G);
+  } } }
+  // Traverse pinned objects
+  // If not all gens are marked, liveness of pinned objects cannot be decided.
+  // Thus all pinned objects are roots in this case.
+  for(k = 0; k < G->n_pins; k++) {
+    zgen_t * const J = G->pins[k];
+    for(off = 0; off < J->size; off++) {
+      if(J->s[off] & ZZ_FREE) continue;
+      // off is a header, and (off + 1) is an object
+      if((!G->mark_all || J->p[off] > 0) && J->m[off + 1] == ZZ_WHITE) {
+        J->m[off + 1] = ZZ_BLACK;
+        zMarkStkPush(G, -1 - k, off + 1);
+        zMarkDrain(G);
+      }
+      for(off += 2; !(J->s[off] & ZZ_SEP); off++);
+      off--;
+  } }
+  zMarkEphemerons(G);
   // Cleanup stack
   zMarkStkClean(G);
+  for(k = 0; k < G->mark_top && k < G->n_gens; k++)
+    G->kstat->marked += G->gens[k]->n_reachables;
+  for(k = 0; k < G->n_pins; k++) G->kstat->marked += G->pins[k]->n_reachables;
+  zEventGC(G, ZZ_EV_MARK, 0, G->kstat->marked - marked);
   return 0;
 }
 
@@ -384,6 +1705,27 @@ static zu_t zFindTopEmptyGenByReachable(zgc_t *G) {
   return k;
 }
 
+static int zDedupStrGC(zgc_t *G, zgen_t *src, zu_t off) {
+  // If there is a canonical string with the same contents as the string at
+  // off, forward the string to it and return 1. Return -1 for a string with
+  // identity, which is neither merged nor canonical. Otherwise return 0.
+  // Canonical strings must not be moved, so they are in gens[move_top..].
+  zstr_t * const s = (zstr_t*) (src->p + off);
+  const zu_t h = zStrHash(s);
+  int k;
+  if(G->sz_idh > 0 && zIdHashSlot(G->idh, G->sz_idh, s)->p) return -1;
+  if(G->dds.n == 0) return 0;
+  const zu_t i = zStabFind(&G->dds, s->c, s->len, h);
+  const zp_t c = G->dds.e[i].p;
+  if(c == NULL) return 0;
+  for(k = G->move_top; k < G->n_gens; k++) {
+    if(zGenPtrIdx(G->gens[k], c) >= 0) {
+      src->p[off] = (zu_t) c;
+      return 1;
+  } }
+  return 0;
+}
+
 static int zReallocGenGC(zgc_t *G, zgen_t *dst, zgen_t *src) {
   // Move alive objects in src into dst
   zu_t off = src->left;
@@ -392,14 +1734,27 @@ static int zReallocGenGC(zgc_t *G, zgen_t *dst, zgen_t *src) {
   // Traverse all objects
   while(off < lim) {
     if(src->m[off]) {
+      const int str = G->str_dedup && (src->s[off] & ZZ_STR) ?
+        zDedupStrGC(G, src, off) : -1;
+      if(str > 0) {
+        // Skip deduplicated string
+        for(off++; off < lim && !(src->s[off] & ZZ_SEP); off++);
+        continue;
+      }
       // Find the longest block to be copied
-      p = off;
-      while(p < lim && (!(src->s[p] & ZZ_SEP) || src->m[p])) p++;
+      // (With deduplication, strings are copied one by one)
+      p = off + 1;
+      while(p < lim && (!(src->s[p] & ZZ_SEP) ||
+        (src->m[p] && !(G->str_dedup && (src->s[p] & ZZ_STR))))) p++;
       const zu_t sz = p - off;
       // Alloc & copy in dst
+      G->kstat->copied += sz;
       dst->left -= sz;
       memcpy(dst->s + dst->left, src->s + off, sizeof(zb_t) * sz);
       memcpy(dst->p + dst->left, src->p + off, sizeof(zu_t) * sz);
+      // Copied string becomes canonical (It may fail, which is harmless)
+      zstr_t * const ds = (zstr_t*) (dst->p + dst->left);
+      if(str == 0) zStabPut(&G->dds, ds, zStrHash(ds));
       // Put new address into original objects
       const zu_t *dp = dst->p + dst->left - off;
       for(; off < p; off++) {
@@ -410,6 +1765,37 @@ static int zReallocGenGC(zgc_t *G, zgen_t *dst, zgen_t *src) {
   return 0;
 }
 
+static zp_t zForwardGC(zgc_t *G, zp_t ptr) {
+  // Return the new address of ptr, or NULL if ptr is collected.
+  // It must be called after copying and before cleaning up gens in zMoveGC.
+  int k;
+  for(k = G->gc_target; k < G->move_top; k++) {
+    zgen_t * const K = G->gens[k];
+    const zi_t idx = zGenPtrIdx(K, ptr);
+    if(idx >= 0) return K->m[idx] ? (zp_t) K->p[idx] : NULL;
+  }
+  if(G->mark_all) {
+    // Pinned objects will be freed by sweep
+    zi_t idx;
+    zgen_t * const K = zFindPin(G, ptr, &idx);
+    if(K && K->m[idx] == ZZ_WHITE && K->p[idx - 1] == 0) return NULL;
+  }
+  return ptr;
+}
+
+static void zUpdateCRef(zgc_t *G, uint32_t *r) {
+  // Update a compressed reference
+  int k;
+  if(*r == 0) return;
+  const zp_t ptr = G->arena->base + *r;
+  for(k = G->gc_target; k < G->move_top; k++) {
+    zgen_t * const K = G->gens[k];
+    const zi_t idx = zGenPtrIdx(K, ptr);
+    if(idx >= 0) {
+      *r = (uint32_t) ((zu_t*) K->p[idx] - G->arena->base);
+      return;
+} } }
+
 static void zGenUpdatePointers(zgc_t *G, zgen_t *J) {
   // Update copied objects' pointer
   int k;
@@ -420,10 +1806,18 @@ static void zGenUpdatePointers(zgc_t *G, zgen_t *J) {
   const int tgt = G->gc_target, top = G->move_top;
   // Traverse all objects
   for(; off < sz; off++) {
-    if(!(s[off] & ZZ_NPTR)) {
+    if(s[off] & ZZ_CREF) {
+      zUpdateCRef(G, (uint32_t*) (p + off));
+      zUpdateCRef(G, (uint32_t*) (p + off) + 1);
+    } else if(!(s[off] & ZZ_NPTR) && !zIsImm(p[off])) {
       // Find pointer's generation & idx in copied source
       // If they are found, the pointer is for copied object
       const zp_t ptr = (zp_t) p[off];
+      if(s[off] & ZZ_WEAK) {
+        // Clear weak pointers to collected objects
+        p[off] = (zu_t) zForwardGC(G, ptr);
+        continue;
+      }
       for(k = tgt; k < top; k++) {
         zgen_t * const K = G->gens[k];
         const zi_t idx = zGenPtrIdx(K, ptr);
@@ -441,7 +1835,7 @@ static void zUpdateRootPointers(zgc_t *G) {
   for(f = G->top_frame; f; f = f->prev) {
     zu_t i;
     for(i = 0; i < f->size; i++) {
-      if(!(f->s[i] & ZZ_NPTR)) {
+      if(!(f->s[i] & ZZ_NPTR) && !zIsImm(f->v[i].u)) {
         const zp_t ptr = (zp_t) f->v[i].p;
         for(k = G->gc_target; k < G->move_top; k++) {
           zgen_t * const K = G->gens[k];
@@ -451,58 +1845,229 @@ static void zUpdateRootPointers(zgc_t *G) {
             break;
 } } } } } }
 
+static void zUpdateIdHashGC(zgc_t *G) {
+  // Update addresses of hashed objects, and remove collected ones.
+  // Addresses are keys of the table, so only moved entries are re-inserted.
+  // (If there is no memory to keep them, the table is rebuilt.)
+  zu_t i, n = 0, sz = 0;
+  zidh_t *mv = NULL;
+  int rebuild = 0;
+  for(i = 0; i < G->sz_idh; i++) {
+    zidh_t * const e = G->idh + i;
+    if(e->p == NULL || e->p == ZZ_IDH_DEAD) continue;
+    const zp_t ptr = zForwardGC(G, e->p);
+    if(ptr == e->p) continue;
+    if(ptr && n >= sz) {
+      zidh_t * const t = (zidh_t*) realloc(mv,
+        sizeof(zidh_t) * (sz > 0 ? sz << 1 : 16));
+      if(t) mv = t, sz = sz > 0 ? sz << 1 : 16;
+    }
+    if(ptr && n >= sz) {
+      e->p = ptr;
+      rebuild = 1;
+      continue;
+    }
+    if(ptr) mv[n].p = ptr, mv[n++].h = e->h;
+    e->p = ZZ_IDH_DEAD;
+    G->n_idh--;
+    G->n_idt++;
+  }
+  if(rebuild || (G->n_idh + G->n_idt + n) * 2 > G->sz_idh)
+    zIdHashResize(G, G->sz_idh);
+  for(i = 0; i < n; i++) zIdHashPut(G, mv[i].p, mv[i].h);
+  free(mv);
+}
+
+static void zUpdateSamplesGC(zgc_t *G) {
+  // Update addresses of sampled objects, and remove collected ones
+  // (Every alive object in the minor gen is promoted)
+  zu_t i;
+  for(i = 0; i < G->n_smps;) {
+    zsample_t * const X = G->smps + i;
+    zsite_t * const S = G->sites + X->site;
+    const zp_t ptr = zForwardGC(G, X->p);
+    if(ptr == NULL) {
+      S->n[ZZ_PROF_LIVE]--;
+      S->words[ZZ_PROF_LIVE] -= X->words;
+      if(X->state == 1) {
+        S->n[ZZ_PROF_PREMATURE]++;
+        S->words[ZZ_PROF_PREMATURE] += X->words;
+      }
+      *X = G->smps[--G->n_smps];
+      continue;
+    }
+    if(X->state == 0) {
+      X->state = 1;
+      S->n[ZZ_PROF_PROMOTED]++;
+      S->words[ZZ_PROF_PROMOTED] += X->words;
+    }
+    X->p = ptr;
+    i++;
+} }
+
+static void zUpdateTraceGC(zgc_t *G) {
+  // Update addresses of traced objects, and remove collected ones
+  ztrace_t * const T = G->trace;
+  zu_t i, n = 0;
+  if(T->replay) {
+    // Keep the order of ids
+    for(i = 0; i < T->n; i++) {
+      if((T->e[n].p = zForwardGC(G, T->e[i].p))) T->e[n++].h = T->e[i].h;
+    }
+    T->n = n;
+    return;
+  }
+  zidh_t * const e = (zidh_t*) calloc(T->sz, sizeof(zidh_t));
+  if(e == NULL) return;
+  for(i = 0; i < T->sz; i++) {
+    if(T->e[i].p) {
+      const zp_t ptr = zForwardGC(G, T->e[i].p);
+      if(ptr) {
+        zidh_t * const x = zIdHashSlot(e, T->sz, ptr);
+        x->p = ptr, x->h = T->e[i].h;
+        n++;
+  } } }
+  free(T->e);
+  T->e = e, T->n = n;
+}
+
+static void zUpdateStabGC(zgc_t *G, zstab_t *T) {
+  // Update strings in the table. Because hashes do not depend on addresses,
+  // collected strings are removed and the others are updated in place.
+  zu_t i;
+  for(i = 0; i < T->sz; i++) {
+    if(T->e[i].h) T->e[i].p = zForwardGC(G, T->e[i].p);
+  }
+  for(i = 0; i < T->sz; i++) {
+    while(T->e[i].h && T->e[i].p == NULL) zStabDelAt(T, i);
+} }
+
+static void zFinalizeGC(zgc_t *G) {
+  // Update objects of finalizers, and run finalizers of collected objects
+  // (Collected objects are untouched until the end of zMoveGC)
+  zu_t i, n = 0;
+  for(i = 0; i < G->n_fins; i++) {
+    zfin_t f = G->fins[i];
+    zp_t ptr = zForwardGC(G, f.p);
+    if(ptr) { // Alive: move to front
+      G->fins[i] = G->fins[n];
+      G->fins[n] = f;
+      G->fins[n++].p = ptr;
+  } }
+  const zu_t m = G->n_fins;
+  G->n_fins = n;
+  for(i = n; i < m; i++) G->fins[i].fn(G, G->fins[i].p, G->fins[i].ud);
+}
+
 static int zMoveGC(zgc_t *G) {
   int j, k;
   // Find destination gen. to copy
   zgen_t *dst;
   int bot = G->gc_target, top = G->move_top;
-  if(top >= G->n_gens) {
+  if(G->gc_merge || top >= G->n_gens) {
     // New generation is required
+    // (Merged gens are copied into a tight one, which is inserted at top. If
+    // it is the youngest major gen, it has room for the next promotion, as
+    // the minor heap size.)
     zu_t sz = 0;
     for(k = bot; k < top; k++) sz += G->gens[k]->n_reachables;
-    sz *= ZZ_NEW_HEAP_SIZE_FACTOR;
-    if(sz < G->major_heap_min_size) sz = G->major_heap_min_size;
-    if((dst = zNewGen(sz)) == NULL) return -1;
-    if(top >= G->sz_gens) {
-      // If gen array is small, extend it
-      G->gens = realloc(G->gens, sizeof(zgen_t**) * (G->sz_gens << 1));
-      G->sz_gens <<= 1;
-    }
+    const zu_t room = bot == 1 ? G->gens[0]->size : 0;
+    if(zReserveGens(G) < 0 ||
+      (dst = zNewGen(G->arena, G->gc_merge ? sz + room + 1 :
+        zNewGenSize(G, sz, G->major_heap_min_size))) == NULL)
+      return -1;
     // Put new gen into array
+    for(k = G->n_gens; k > top; k--) G->gens[k] = G->gens[k - 1];
     G->gens[top] = dst;
+    // Ephemeron tables recorded in shifted gens
+    for(j = 0; j < (int) G->n_ephs; j++) {
+      const int gen = (int) (zi_t) G->ephs[j << 1];
+      if(gen >= top) G->ephs[j << 1] = (zu_t) (zi_t) (gen + 1);
+    }
     G->n_gens++;
+    G->kstat->gens_created++;
   } else dst = G->gens[top];
+  // Statistics of collected gens (before copy)
+  for(k = bot; k < top; k++) {
+    zgen_t * const J = G->gens[k];
+    const int i = k < ZZ_STAT_GENS ? k : ZZ_STAT_GENS - 1;
+    G->kstat->gen_allocated[i] += J->size - J->left;
+    G->kstat->gen_survived[i] += J->n_reachables;
+  }
+  if(bot == 0) G->kstat->promoted += G->gens[0]->n_reachables;
   // Reallocate (copy)
+  const zu_t copied = G->kstat->copied;
+  zEventGC(G, ZZ_EV_COPY, 1, 0);
   for(j = top - 1; j >= (zi_t) bot; j--) {
     if(zReallocGenGC(G, dst, G->gens[j]) < 0) return -1;
   }
+  zEventGC(G, ZZ_EV_COPY, 0, G->kstat->copied - copied);
   // Change all reallocated pointers
   const int jt = G->has_cyclic_ref ? G->n_gens : top + 1;
-  for(j = 0; j < bot; j++) zGenUpdatePointers(G, G->gens[j]);
-  for(j = top; j < jt; j++) zGenUpdatePointers(G, G->gens[j]);
+  zu_t work = 0;
+  zEventGC(G, ZZ_EV_UPDATE, 1, 0);
+  for(j = 0; j < bot; j++) {
+    zGenUpdatePointers(G, G->gens[j]);
+    work += G->gens[j]->size - G->gens[j]->left;
+  }
+  for(j = top; j < jt; j++) {
+    zGenUpdatePointers(G, G->gens[j]);
+    work += G->gens[j]->size - G->gens[j]->left;
+  }
+  for(j = 0; j < G->n_pins; j++) {
+    zGenUpdatePointers(G, G->pins[j]);
+    work += G->pins[j]->size;
+  }
   zUpdateRootPointers(G);
+  zEventGC(G, ZZ_EV_UPDATE, 0, work);
+  // Weak processing
+  work = G->n_fins + G->sz_idh + G->n_smps + G->syms.sz + G->dds.sz +
+    G->n_ephs;
+  zEventGC(G, ZZ_EV_WEAK, 1, 0);
+  zFinalizeGC(G);
+  zUpdateIdHashGC(G);
+  zUpdateSamplesGC(G);
+  if(G->trace) zUpdateTraceGC(G);
+  zUpdateStabGC(G, &G->syms);
+  zUpdateStabGC(G, &G->dds);
+  for(j = 0; j < G->n_ephs; j++) zMapSweep(zForwardGC(G, zEphAt(G, j)));
+  zEventGC(G, ZZ_EV_WEAK, 0, work);
   // Clean up generations
+  zEventGC(G, ZZ_EV_CLEAN, 1, 0);
   for(k = 0; k < bot; k++) zGenCleanMarks(G->gens[k]);
   for(; k < top; k++) zGenCleanAll(G->gens[k]);
   for(; k < G->n_gens; k++) zGenCleanMarks(G->gens[k]);
+  // Sweep pinned gens only if all gens are marked
+  for(k = 0; k < G->n_pins; k++) {
+    if(G->mark_all) zPinGenSweep(G->pins[k]);
+    else zGenCleanMarks(G->pins[k]);
+  }
+  zEventGC(G, ZZ_EV_CLEAN, 0, 0);
   return 0;
 }
 
 static int zReduceEmptyGC(zgc_t *G) {
   int k;
   zu_t total = 0, allocated = 0;
+  const zu_t deleted = G->kstat->gens_deleted;
+  zEventGC(G, ZZ_EV_REDUCE, 1, 0);
   // Calculate current total/allocated words
   for(k = 1; k < G->n_gens; k++) {
     total += G->gens[k]->size;
     allocated += G->gens[k]->size - G->gens[k]->left;
   }
   // Remove gens while (allocated / total) < 1 / HEAP_ENTRY_LIMIT_INV
-  for(k = G->n_gens - 1;
-      k >= 1 && total > allocated * ZZ_HEAP_EMPTY_LIMIT_INV; k--) {
+  // (Merged gens, or gens over the max are always removed)
+  int n = G->n_gens - 1;
+  for(k = G->n_gens - 1; k >= 1 && (G->gc_merge ||
+      total > allocated * G->empty_limit_inv ||
+      (G->max_gens > 0 && n > G->max_gens)); k--) {
     if(G->gens[k]->left == G->gens[k]->size) {
       total -= G->gens[k]->size;
+      n--;
       zDelGen(G->gens[k]);
       G->gens[k] = NULL;
+      G->kstat->gens_deleted++;
     }
   }
   // Erase deleted generations
@@ -512,13 +2077,214 @@ static int zReduceEmptyGC(zgc_t *G) {
     else G->gens[k - d] = G->gens[k];
   }
   G->n_gens -= d;
+  // Remove empty pinned gens
+  for(d = 0, k = 0; k < G->n_pins; k++) {
+    if(G->pins[k]->n_free == G->pins[k]->size) {
+      zDelGen(G->pins[k]);
+      d++;
+    } else G->pins[k - d] = G->pins[k];
+  }
+  G->n_pins -= d;
+  zEventGC(G, ZZ_EV_REDUCE, 0, G->kstat->gens_deleted - deleted);
   return 0;
 }
 
-int zRunGC(zgc_t *G) {
+static zu_t zMajorWords(zgc_t *G) {
+  // Allocated words in major gens
+  zu_t w = 0;
+  int k;
+  for(k = 1; k < G->n_gens; k++) w += G->gens[k]->size - G->gens[k]->left;
+  return w;
+}
+
+static void zBeginGC(zgc_t *G, zgckstat_t *K) {
+  G->kstat = K;
+  G->gc_start = zNowNs();
+  G->gc_copied = K->copied;
+  // Minor GCs are measured by the minor heap, and full GCs by all gens
+  // (Merges are not measured)
+  G->gc_words = K == &G->stats.merge ? 0 : G->gens[0]->size - G->gens[0]->left;
+  if(K == &G->stats.full) G->gc_words += zMajorWords(G);
+  zEventGC(G, ZZ_EV_GC, 1, 0);
+}
+
+static zu_t zClampMinor(zu_t sz) {
+  return sz < ZZ_ADAPT_MINOR_MIN ? ZZ_ADAPT_MINOR_MIN :
+    sz > ZZ_ADAPT_MINOR_MAX ? ZZ_ADAPT_MINOR_MAX : sz;
+}
+
+static void zAdaptGC(zgc_t *G, uint64_t t, uint64_t now) {
+  // Ergonomics: choose the sizing policy after a collection of t ns
+  zgen_t * const minor = G->gens[0];
+  const double mut = G->gc_start > G->gc_end ? G->gc_start - G->gc_end : 0;
+  const double frac = t + mut > 0 ? t / (t + mut) : 0;
+  const zu_t major = zMajorWords(G);
+  const int full = G->kstat == &G->stats.full;
+  // GC time fraction, weighted toward recent collections
+  G->stats.gc_fraction = G->stats.gc_fraction * (1 - ZZ_ADAPT_WEIGHT) +
+    frac * ZZ_ADAPT_WEIGHT;
+  if(G->goal == ZZ_GOAL_GC_FRACTION) {
+    const double f = G->stats.gc_fraction, g = G->goal_value;
+    const zgckstat_t * const K = &G->stats.minor;
+    const zu_t a = K->gen_allocated[0];
+    // Minor survival: a larger minor heap helps only if most objects die young
+    const double sv = a ? (double) K->gen_survived[0] / a : 0;
+    if(f > g) {
+      // Too much GC: collect less often
+      if(sv < 0.5) G->minor_target = zClampMinor(minor->size << 1);
+      G->heap_factor *= 1.25;
+      if(G->empty_limit_inv < 16) G->empty_limit_inv++;
+    } else if(f < g / 2) {
+      // GC is cheap enough: save memory
+      G->minor_target = zClampMinor(minor->size >> 1);
+      G->heap_factor /= 1.25;
+      if(G->empty_limit_inv > 2) G->empty_limit_inv--;
+    }
+    if(G->heap_factor < ZZ_ADAPT_FACTOR_MIN)
+      G->heap_factor = ZZ_ADAPT_FACTOR_MIN;
+    if(G->heap_factor > ZZ_ADAPT_FACTOR_MAX)
+      G->heap_factor = ZZ_ADAPT_FACTOR_MAX;
+    // Old gens are collected when they grow by the factor
+    if(full || G->major_trigger == 0) {
+      const zu_t grow = (zu_t) (major * G->heap_factor);
+      G->major_trigger = (grow > G->major_heap_min_size ?
+        grow : G->major_heap_min_size) + minor->size;
+    }
+  } else if(G->goal == ZZ_GOAL_MAX_HEAP) {
+    const zu_t limit = (zu_t) G->goal_value;
+    // Minor heap is 1/8 of the limit, and the others are for major gens
+    G->minor_target = zClampMinor(limit / 8);
+    const zu_t room = limit - G->minor_target;
+    // Free space is given by the rest of the limit, and empty gens are
+    // removed immediately
+    G->heap_factor = major > 0 && room > major ? (double) room / major : 1;
+    if(G->heap_factor > ZZ_NEW_HEAP_SIZE_FACTOR)
+      G->heap_factor = (double) ZZ_NEW_HEAP_SIZE_FACTOR;
+    if(G->heap_factor < ZZ_ADAPT_FACTOR_MIN)
+      G->heap_factor = ZZ_ADAPT_FACTOR_MIN;
+    G->empty_limit_inv = 1;
+    // Collect all gens when major gens use a half of the rest after the last
+    // full GC (but at least 1/4 of alive words to avoid thrashing)
+    if(full || G->major_trigger == 0) {
+      const zu_t half = room > major ? (room - major) / 2 : 0;
+      G->major_trigger = major + (half > major / 4 ? half : major / 4) + 1;
+    }
+  }
+  // Resize minor heap, which is empty after GC
+  if(G->minor_target && G->minor_target != minor->size &&
+    minor->left == minor->size) {
+    zgen_t * const J = zNewGen(G->arena, G->minor_target);
+    if(J) {
+      zDelGen(minor);
+      G->gens[0] = J;
+      G->stats.minor_resizes++;
+  } }
+  G->gc_end = now;
+}
+
+static void zEndGC(zgc_t *G) {
+  // Update GC states after each collection
+  zgckstat_t * const K = G->kstat;
+  const uint64_t now = zNowNs(), t = now - G->gc_start;
+  const int full = K == &G->stats.full;
+  int k;
+  ++G->n_collection;
+  ++K->count;
+  K->pause_ns += t;
+  if(t > K->max_pause_ns) K->max_pause_ns = t;
+  uint64_t us = t / 1000;
+  for(k = 0; us > 0 && k < ZZ_STAT_HIST - 1; k++) us >>= 1;
+  K->hist[k]++;
+  G->ext_minor = 0;
+  // Only after a full collection (minor GCs also mark all in cyclic mode)
+  if(full) {
+    G->ext_limit = G->ext_bytes * ZZ_EXT_LIMIT_FACTOR;
+    if(G->ext_limit < ZZ_EXT_MIN_LIMIT) G->ext_limit = ZZ_EXT_MIN_LIMIT;
+    // Next full GC by pinned allocation, when pinned words grow by the factor
+    zu_t pinned = 0;
+    for(k = 0; k < G->n_pins; k++)
+      pinned += G->pins[k]->size - G->pins[k]->n_free;
+    G->pin_alloc = 0;
+    G->pin_limit = pinned * ZZ_NEW_HEAP_SIZE_FACTOR;
+    if(G->pin_limit < ZZ_DEFAULT_PIN_HEAP_SIZE)
+      G->pin_limit = ZZ_DEFAULT_PIN_HEAP_SIZE;
+  }
+  G->reserve_lim = (zu_t) -1;
+  // Restore the minor heap enlarged by a reservation
+  if(G->reserve_minor && G->gens[0]->left == G->gens[0]->size) {
+    zgen_t * const J = zNewGen(G->arena, G->reserve_minor);
+    if(J) {
+      zDelGen(G->gens[0]);
+      G->gens[0] = J;
+      G->reserve_minor = 0;
+  } }
+  // Pause estimate for idle time, weighted toward recent collections
+  if(G->gc_words > 0) {
+    const double r = (double) t / G->gc_words;
+    G->idle_rate[full] = G->idle_rate[full] > 0 ?
+      G->idle_rate[full] * (1 - ZZ_ADAPT_WEIGHT) + r * ZZ_ADAPT_WEIGHT : r;
+  }
+  if(full) G->idle_live = zMajorWords(G);
+  zAdaptGC(G, t, now);
+  zEventGC(G, ZZ_EV_GC, 0, K->copied - G->gc_copied);
+}
+
+static zu_t zPickMergeGC(zgc_t *G, int *pa, int *pb) {
+  // Find adjacent sparse major gens, or the cheapest ones if there are too
+  // many gens, as [*pa, *pb). Returns their allocated words, or -1 if none.
+  int a, b, len;
+  zu_t best = (zu_t) -1;
+  const int n = G->n_gens - 1;
+  if(G->max_gens == 0) return best;
+  if(n > G->max_gens) {
+    len = n - G->max_gens + 1;
+    for(a = 1; a + len <= G->n_gens; a++) {
+      zu_t w = 0;
+      for(b = a; b < a + len; b++) w += G->gens[b]->size - G->gens[b]->left;
+      if(w < best) best = w, *pa = a, *pb = a + len;
+    }
+  } else {
+    for(a = 1; a + 2 <= G->n_gens; a++) {
+      const zu_t w = (G->gens[a]->size - G->gens[a]->left) +
+        (G->gens[a + 1]->size - G->gens[a + 1]->left);
+      const zu_t sz = G->gens[a]->size + G->gens[a + 1]->size;
+      if(w * ZZ_SPARSE_GENS_INV < sz && w < best)
+        best = w, *pa = a, *pb = a + 2;
+    }
+  }
+  return best;
+}
+
+static int zMergeGC(zgc_t *G, int ba, int bb) {
+  // Merge gens[ba..bb) into a new gen at the same position.
+  zBeginGC(G, &G->stats.merge);
+  G->gc_target = ba;
+  // Older gens never refer the merged ones without cyclic references
+  G->mark_top = G->has_cyclic_ref ? G->n_gens : bb;
+  G->move_top = bb;
+  G->gc_merge = 1;
+  if(zMarkGC(G) < 0 || zMoveGC(G) < 0 || zReduceEmptyGC(G) < 0) {
+    G->gc_merge = 0;
+    return -1;
+  }
+  G->gc_merge = 0;
+  G->stats.merged_gens += bb - ba;
+  zEndGC(G);
+  return 0;
+}
+
+static int zConsolidateGC(zgc_t *G) {
+  // Returns 1 if merged, 0 if not needed, -1 on failure.
+  int ba, bb;
+  if(zPickMergeGC(G, &ba, &bb) == (zu_t) -1) return 0;
+  return zMergeGC(G, ba, bb) < 0 ? -1 : 1;
+}
+
+static int zMinorGCIn(zgc_t *G) {
   // Make a space in minor heap
   // Check GC is need
   if(G->gens[0]->left >= G->gens[0]->size) return 1;
+  zBeginGC(G, &G->stats.minor);
   // Set minor heap as the GC target
   G->gc_target = 0;
   // Find youngest generation which cannot be moved / point objects possible to
@@ -531,27 +2297,99 @@ int zRunGC(zgc_t *G) {
   G->move_top = zFindTopEmptyGenByReachable(G);
   // Copying phase & remove empty generations
   if(zMoveGC(G) < 0 || zReduceEmptyGC(G) < 0) return -1;
-  ++G->n_collection;
+  zEndGC(G);
   return 0;
 }
 
-int zFullGC(zgc_t *G) {
+static int zRunGCIn(zgc_t *G) {
+  const int r = zMinorGCIn(G);
+  if(r != 0) return r;
+  // Old gens grew too much
+  if(G->major_trigger && zMajorWords(G) > G->major_trigger)
+    return zFullGCIn(G);
+  return zConsolidateGC(G) < 0 ? -1 : 0;
+}
+
+static int zFullGCIn(zgc_t *G) {
   // Copy all memories into a single major gen.
+  zBeginGC(G, &G->stats.full);
   G->gc_target = 0;
   G->mark_top = G->move_top = G->n_gens;
   if(zMarkGC(G) < 0 || zMoveGC(G) < 0 || zReduceEmptyGC(G) < 0)
     return -1;
-  ++G->n_collection;
+  zEndGC(G);
   return 0;
 }
 
+int zRunGC(zgc_t *G) {
+  zTraceOp(G, 'G', 0, 0, 0, 0);
+  return zRunGCIn(G);
+}
+
+int zFullGC(zgc_t *G) {
+  zTraceOp(G, 'g', 0, 0, 0, 0);
+  return zFullGCIn(G);
+}
+
+// Idle-time GC
+static int zIdleFits(zgc_t *G, int full, zu_t words, uint64_t deadline) {
+  // Estimate the pause by the rate of the same kind, or the other kind if
+  // unknown. (Nothing is known before the first collection)
+  const double r = G->idle_rate[full] > 0 ?
+    G->idle_rate[full] : G->idle_rate[!full];
+  return zNowNs() + (uint64_t) (r * words) <= deadline;
+}
+
+static int zFullDue(zgc_t *G) {
+  const zu_t live = G->idle_live, major = zMajorWords(G);
+  zu_t room = live > G->major_heap_min_size ? live : G->major_heap_min_size;
+  if(G->major_trigger > live) room = G->major_trigger - live;
+  return major > live + room / ZZ_IDLE_FULL_INV;
+}
+
+int zGCIdle(zgc_t *G, uint64_t deadline) {
+  // Run collections in the order of usefulness while they fit.
+  zgen_t * const minor = G->gens[0];
+  const zu_t used = minor->size - minor->left;
+  int ba, bb;
+  zu_t w;
+  // Empty the minor heap before the next request fills it
+  if(used > 0 && used * ZZ_IDLE_MINOR_INV >= minor->size) {
+    if(!zIdleFits(G, 0, used, deadline)) return 1;
+    zTraceOp(G, 'G', 0, 0, 0, 0);
+    if(zMinorGCIn(G) < 0) return -1;
+    G->stats.idle_gcs++;
+  }
+  // Collect major gens before they reach the trigger
+  if(zFullDue(G)) {
+    w = G->gens[0]->size - G->gens[0]->left + zMajorWords(G);
+    if(!zIdleFits(G, 1, w, deadline)) return 1;
+    zTraceOp(G, 'g', 0, 0, 0, 0);
+    if(zFullGCIn(G) < 0) return -1;
+    G->stats.idle_gcs++;
+  }
+  // Merge sparse gens one by one, which releases their space
+  while((w = zPickMergeGC(G, &ba, &bb)) != (zu_t) -1) {
+    if(!zIdleFits(G, 1, w, deadline)) return 1;
+    if(zMergeGC(G, ba, bb) < 0) return -1;
+    G->stats.idle_gcs++;
+  }
+  return 0;
+}
+
+uint64_t zGCNowNs(void) {
+  return zNowNs();
+}
+
 // Root frames
 void zGCPushFrame(zgc_t *G, int sz) {
+  zTraceOp(G, 'F', 1, (zu_t) sz, 0, 0);
   G->top_frame = zNewFrame(sz, G->top_frame);
 }
 void zGCPopFrame(zgc_t *G) {
   if(G->top_frame != NULL && G->top_frame != G->bot_frame) {
     zframe_t *f = G->top_frame;
+    zTraceOp(G, 'f', 0, 0, 0, 0);
     G->top_frame = f->prev;
     free(f);
   }
@@ -569,20 +2407,33 @@ ztag_t zGCBotFrame(zgc_t *G, int idx) {
   return G->bot_frame->v[idx];
 }
 void zGCSetTopFrame(zgc_t *G, int idx, ztag_t v, int is_nptr) {
+  if(zRecording(G))
+    zTraceOp(G, 'S', 3, 0, (zu_t) idx, zTraceRef(G, v.p, is_nptr));
   G->top_frame->v[idx] = v;
   G->top_frame->s[idx] = is_nptr ? ZZ_NPTR : 0;
 }
 void zGCSetBotFrame(zgc_t *G, int idx, ztag_t v, int is_nptr) {
+  if(zRecording(G))
+    zTraceOp(G, 'S', 3, 1, (zu_t) idx, zTraceRef(G, v.p, is_nptr));
   G->bot_frame->v[idx] = v;
   G->bot_frame->s[idx] = is_nptr ? ZZ_NPTR : 0;
 }
+ztag_t* zGCTopFrameSlot(zgc_t *G, int idx) {
+  G->top_frame->s[idx] = 0;
+  return G->top_frame->v + idx;
+}
+ztag_t* zGCBotFrameSlot(zgc_t *G, int idx) {
+  G->bot_frame->s[idx] = 0;
+  return G->bot_frame->v + idx;
+}
 
 int zAllowCyclicRefGC(zgc_t *G, int v) {
+  zTraceOp(G, 'C', 1, (zu_t) (v + 1), 0, 0);
   if(v > 0) { // ENABLE cyclic reference
     G->has_cyclic_ref = 1;
     return 1;
   } else if(v == 0) { // DISABLE cyclic reference
-    if(zFullGC(G) < 0) return -1;
+    if(zFullGCIn(G) < 0) return -1;
     G->has_cyclic_ref = 0;
     return 0;
   } else { // DISABLE cyclic reference w.o. full gc
@@ -592,7 +2443,7 @@ int zAllowCyclicRefGC(zgc_t *G, int v) {
 } }
 
 // GC Information
-zu_t zNGen(zgc_t *G) {
+zu_t zGCNGen(zgc_t *G) {
   return G->n_gens;
 }
 zu_t zGCReservedSlots(zgc_t *G, int idx) {
@@ -614,6 +2465,473 @@ zu_t zGCLeftSlots(zgc_t *G, int idx) {
 zu_t zGCAllocatedSlots(zgc_t *G, int idx) {
   return zGCReservedSlots(G, idx) - zGCLeftSlots(G, idx);
 }
+zu_t zGCExternalBytes(zgc_t *G) {
+  return G->ext_bytes;
+}
+
+void zGCGetStats(zgc_t *G, zgcstats_t *dst) {
+  int i;
+  *dst = G->stats;
+  for(i = 0; i < ZZ_STAT_GENS; i++) {
+    const zu_t a = dst->minor.gen_allocated[i], b = dst->full.gen_allocated[i];
+    dst->minor.survival[i] = a ? (double) dst->minor.gen_survived[i] / a : 0;
+    dst->full.survival[i] = b ? (double) dst->full.gen_survived[i] / b : 0;
+  }
+}
+void zGCResetStats(zgc_t *G) {
+  memset(&G->stats, 0x00, sizeof(zgcstats_t));
+}
+
+// Allocation sampling
+void zGCSetAllocSampling(zgc_t *G, zu_t words) {
+  G->smp_mean = words;
+  G->smp_left = words > 0 ? zSampleInterval(G) : (zu_t) -1;
+}
+
+void zGCSetAllocSite(zgc_t *G, zu_t site) {
+  G->smp_site = site;
+}
+
+int zGCWriteAllocProfile(zgc_t *G, FILE *f, int kind) {
+  // Legacy heap profile of pprof (heap_v2): Each line is
+  //   <count>: <bytes> [<alloc count>: <alloc bytes>] @ <stack>
+  // with sampled counts, and pprof scales them by the sampling interval.
+  zu_t n = 0, w = 0, an = 0, aw = 0;
+  int i, k;
+  if(kind < ZZ_PROF_ALLOC || kind > ZZ_PROF_PREMATURE) return -1;
+  for(i = 0; i < G->n_sites; i++) {
+    n += G->sites[i].n[kind], w += G->sites[i].words[kind];
+    an += G->sites[i].n[0], aw += G->sites[i].words[0];
+  }
+  fprintf(f, "heap profile: %" PRIuPTR ": %" PRIuPTR " [%" PRIuPTR ": %"
+    PRIuPTR "] @ heap_v2/%" PRIuPTR "\n", n, zWordsToBytes(w), an,
+    zWordsToBytes(aw), zWordsToBytes(G->smp_mean));
+  for(i = 0; i < G->n_sites; i++) {
+    zsite_t * const S = G->sites + i;
+    fprintf(f, "%" PRIuPTR ": %" PRIuPTR " [%" PRIuPTR ": %" PRIuPTR "] @",
+      S->n[kind], zWordsToBytes(S->words[kind]), S->n[0],
+      zWordsToBytes(S->words[0]));
+    for(k = 0; k < S->depth; k++) fprintf(f, " 0x%" PRIxPTR, (zu_t) S->stk[k]);
+    fprintf(f, "\n");
+  }
+  // Mappings are required to symbolize backtraces
+  fprintf(f, "\nMAPPED_LIBRARIES:\n");
+  FILE * const maps = fopen("/proc/self/maps", "r");
+  if(maps) {
+    char buf[512];
+    size_t m;
+    while((m = fread(buf, 1, sizeof(buf), maps)) > 0) fwrite(buf, 1, m, f);
+    fclose(maps);
+  }
+  return ferror(f) ? -1 : 0;
+}
+
+void zGCResetAllocProfile(zgc_t *G) {
+  G->n_smps = 0;
+  G->n_sites = 0;
+  if(G->site_idx) memset(G->site_idx, 0xff, sizeof(int) * G->sz_site_idx);
+}
+
+// Heap dump
+// Format: "ZZHD", version(1 byte), word size(1 byte), and then records.
+// Every number is an unsigned LEB128.
+// - 'R' addr: root
+// - 'O' addr gen flags size tag layout[ceil(size / 8)] n_refs refs[n_refs]:
+//   object, where gen is an index of pinned gens if ZZ_DUMP_PINNED is set,
+//   tag is the first word, and i-th bit of layout is set for a pointer word.
+//   refs are strong references. (including compressed ones)
+// - 'E': end
+static zp_t zDumpRef(zgc_t *G, zgen_t *J, zu_t off, int i) {
+  // i-th strong reference in the word at off, or NULL
+  const zb_t s = J->s[off];
+  if(s & ZZ_CREF) {
+    const uint32_t r = ((uint32_t*) (J->p + off))[i];
+    return r ? (zp_t) (G->arena->base + r) : NULL;
+  }
+  if(i > 0 || (s & (ZZ_NPTR | ZZ_WEAK)) || zIsImm(J->p[off])) return NULL;
+  return (zp_t) J->p[off];
+}
+
+static void zDumpObject(zgc_t *G, FILE *f, zgen_t *J, zu_t off, zu_t end,
+    zu_t gen, int flags) {
+  zu_t k, n = 0;
+  int i;
+  zb_t b = 0;
+  for(k = off; k < end; k++) {
+    if(J->s[k] & ZZ_WEAK) flags |= ZZ_DUMP_WEAK;
+    if(J->s[k] & ZZ_CREF) flags |= ZZ_DUMP_CREF;
+    for(i = 0; i < 2; i++) n += zDumpRef(G, J, k, i) != NULL;
+  }
+  if(J->s[off] & ZZ_STR) flags |= ZZ_DUMP_STR;
+  if(J->s[off] & ZZ_EPH) flags |= ZZ_DUMP_EPH;
+  fputc('O', f);
+  zWriteNum(f, (zu_t) (J->p + off));
+  zWriteNum(f, gen);
+  zWriteNum(f, flags);
+  zWriteNum(f, end - off);
+  zWriteNum(f, J->p[off]);
+  for(k = off; k < end; k++) {
+    if(!(J->s[k] & ZZ_NPTR)) b |= 1 << ((k - off) & 7);
+    if(((k - off) & 7) == 7 || k + 1 == end) {
+      fputc(b, f);
+      b = 0;
+  } }
+  zWriteNum(f, n);
+  for(k = off; k < end; k++) {
+    for(i = 0; i < 2; i++) {
+      const zp_t r = zDumpRef(G, J, k, i);
+      if(r) zWriteNum(f, (zu_t) r);
+} } }
+
+int zGCHeapDump(zgc_t *G, FILE *f) {
+  zgckstat_t K, * const kstat = G->kstat;
+  const zgchook_t hook = G->hook;
+  const int perf_on = G->perf_on;
+  zframe_t *fr;
+  zu_t off, end;
+  int k, r;
+  // Mark all gens, without events (it is not a collection)
+  memset(&K, 0x00, sizeof(K));
+  G->kstat = &K;
+  G->hook = NULL;
+  G->perf_on = 0;
+  G->gc_target = 0;
+  G->mark_top = G->n_gens;
+  r = zMarkGC(G);
+  G->kstat = kstat;
+  G->hook = hook;
+  G->perf_on = perf_on;
+  if(r < 0) return -1;
+  fwrite("ZZHD", 1, 4, f);
+  fputc(ZZ_DUMP_VERSION, f);
+  fputc(ZZ_SZPTR, f);
+  // Roots
+  for(fr = G->top_frame; fr; fr = fr->prev) {
+    for(k = 0; k < fr->size; k++) {
+      if(!(fr->s[k] & ZZ_NPTR) && fr->v[k].p && !zIsImm(fr->v[k].u)) {
+        fputc('R', f);
+        zWriteNum(f, fr->v[k].u);
+  } } }
+  for(k = 0; k < G->n_pins; k++) {
+    zgen_t * const J = G->pins[k];
+    for(off = 0; off < J->size; off = end) {
+      if(J->s[off] & ZZ_FREE) {
+        end = off + 1;
+        continue;
+      }
+      for(end = off + 2; end < J->size && !(J->s[end] & ZZ_SEP); end++);
+      if(J->p[off] > 0) {
+        fputc('R', f);
+        zWriteNum(f, (zu_t) (J->p + off + 1));
+  } } }
+  // Alive objects
+  for(k = 0; k < G->n_gens; k++) {
+    zgen_t * const J = G->gens[k];
+    for(off = J->left; off < J->size; off = end) {
+      for(end = off + 1; end < J->size && !(J->s[end] & ZZ_SEP); end++);
+      if(J->m[off]) zDumpObject(G, f, J, off, end, k, 0);
+    }
+    zGenCleanMarks(J);
+  }
+  for(k = 0; k < G->n_pins; k++) {
+    zgen_t * const J = G->pins[k];
+    for(off = 0; off < J->size; off = end) {
+      if(J->s[off] & ZZ_FREE) {
+        end = off + 1;
+        continue;
+      }
+      for(end = off + 2; end < J->size && !(J->s[end] & ZZ_SEP); end++);
+      if(J->m[off + 1]) zDumpObject(G, f, J, off + 1, end, k, ZZ_DUMP_PINNED);
+    }
+    zGenCleanMarks(J);
+  }
+  fputc('E', f);
+  fflush(f);
+  return ferror(f) ? -1 : 0;
+}
+
+// Ergonomics
+int zGCSetGoal(zgc_t *G, int goal, double value) {
+  if(goal == ZZ_GOAL_NONE) {
+    G->heap_factor = (double) ZZ_NEW_HEAP_SIZE_FACTOR;
+    G->empty_limit_inv = ZZ_HEAP_EMPTY_LIMIT_INV;
+    G->minor_target = G->major_trigger = 0;
+  } else if(goal == ZZ_GOAL_GC_FRACTION) {
+    if(!(value > 0 && value < 1)) return -1;
+  } else if(goal == ZZ_GOAL_MAX_HEAP) {
+    if(!(value >= ZZ_ADAPT_MINOR_MIN * 4)) return -1;
+    G->minor_target = zClampMinor((zu_t) value / 8);
+    G->major_trigger = 0;
+  } else return -1;
+  G->goal = goal;
+  G->goal_value = value;
+  return 0;
+}
+
+// Hardware counters
+int zGCSetPerfCounters(zgc_t *G, int on) {
+  int i, r = 0;
+  for(i = 0; i < ZZ_PERF_N; i++) {
+#ifdef ZZ_HAS_PERF
+    if(G->perf_fd[i] >= 0) close(G->perf_fd[i]);
+#endif
+    G->perf_fd[i] = -1;
+  }
+  G->perf_on = 0;
+  if(!on) return 0;
+#ifdef ZZ_HAS_PERF
+  static const struct { uint32_t type; uint64_t config; } evs[ZZ_PERF_N] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  };
+#ifndef PERF_FLAG_FD_CLOEXEC
+#define PERF_FLAG_FD_CLOEXEC 0
+#endif
+  for(i = 0; i < ZZ_PERF_N; i++) {
+    // Counters of the calling thread in user space, opened independently
+    // because some of them may be unavailable (e.g. in VMs)
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = evs[i].type;
+    a.config = evs[i].config;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    G->perf_fd[i] = (int) syscall(SYS_perf_event_open, &a, 0, -1, -1,
+      PERF_FLAG_FD_CLOEXEC);
+    if(G->perf_fd[i] >= 0) r |= 1 << i;
+    else G->perf_fd[i] = -1;
+  }
+  G->perf_on = r != 0;
+#endif
+  return r;
+}
+
+const char* zGCPerfName(int counter) {
+  static const char *names[] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses"
+  };
+  if(counter < 0 || counter >= ZZ_PERF_N) return "unknown";
+  return names[counter];
+}
+
+// GC Events
+void zGCSetHook(zgc_t *G, zgchook_t fn, zp_t ud) {
+  G->hook = fn;
+  G->hook_ud = ud;
+}
+
+const char* zGCEventName(int kind) {
+  static const char *names[] = {
+    "gc", "mark", "copy", "update", "weak", "clean", "reduce"
+  };
+  if(kind < 0 || kind >= (int) (sizeof(names) / sizeof(names[0])))
+    return "unknown";
+  return names[kind];
+}
+
+static long zGCTracePid(void) {
+#ifdef ZZ_HAS_MMAP
+  return (long) getpid();
+#else
+  return 1;
+#endif
+}
+
+static void zTraceHook(zgc_t *G, const zgcevent_t *e, zp_t ud) {
+  // Chrome trace event: ts is in us
+  fprintf((FILE*) ud,
+    ",\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%c\","
+    "\"ts\":%" PRIu64 ".%03u,\"pid\":%ld,\"tid\":1",
+    zGCEventName(e->kind), e->begin ? 'B' : 'E', e->ts / 1000,
+    (unsigned) (e->ts % 1000), zGCTracePid());
+  if(e->begin) fprintf((FILE*) ud, ",\"args\":{\"full\":%d}}", e->full);
+  else fprintf((FILE*) ud, ",\"args\":{\"work\":%" PRIuPTR "}}", e->work);
+}
+
+void zGCTraceJSON(zgc_t *G, FILE *f) {
+  // The first event is metadata, and the others are prefixed by commas
+  fprintf(f,
+    "[{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":1,"
+    "\"args\":{\"name\":\"zzgc\"}}", zGCTracePid());
+  zGCSetHook(G, zTraceHook, (zp_t) f);
+}
+
+void zGCTraceEnd(zgc_t *G) {
+  if(G->hook != zTraceHook) return;
+  fprintf((FILE*) G->hook_ud, "\n]\n");
+  fflush((FILE*) G->hook_ud);
+  zGCSetHook(G, NULL, NULL);
+}
+
+// Allocation trace
+void zGCSetRef(zgc_t *G, zp_t obj, zu_t idx, zp_t v) {
+  // Stores into unknown objects are not recorded
+  zu_t r;
+  if(zRecording(G) && (r = zTraceRef(G, obj, 0)) >= 2)
+    zTraceOp(G, 'W', 3, r - 2, idx, zTraceRef(G, v, 0));
+  ((zp_t*) obj)[idx] = v;
+}
+
+int zGCRecordAllocs(zgc_t *G, FILE *f) {
+  if(G->trace) return -1;
+  if((G->trace = (ztrace_t*) calloc(1, sizeof(ztrace_t))) == NULL) return -1;
+  G->trace->f = f;
+  fwrite("ZZTR", 1, 4, f);
+  fputc(ZZ_TRACE_VERSION, f);
+  fputc(ZZ_SZPTR, f);
+  zWriteNum(f, (zu_t) G->bot_frame->size);
+  zWriteNum(f, (zu_t) G->has_cyclic_ref);
+  return ferror(f) ? -1 : 0;
+}
+
+int zGCRecordEnd(zgc_t *G) {
+  ztrace_t * const T = zRecording(G);
+  int r;
+  if(T == NULL) return -1;
+  fputc('E', T->f);
+  fflush(T->f);
+  r = ferror(T->f) ? -1 : 0;
+  free(T->e);
+  free(T);
+  G->trace = NULL;
+  return r;
+}
+
+static int zReadNum(FILE *f, zu_t *v) {
+  int c, sh = 0;
+  *v = 0;
+  do {
+    if((c = fgetc(f)) == EOF || sh >= ZZ_SZPTR * 8) return -1;
+    *v |= (zu_t) (c & 0x7f) << sh;
+    sh += 7;
+  } while(c & 0x80);
+  return 0;
+}
+
+static zp_t zTraceObj(zgc_t *G, zu_t ref) {
+  // Object of ref in replaying, or NULL if it is unknown or collected
+  ztrace_t * const T = G->trace;
+  zu_t l = 0, r = T->n;
+  if(ref < 2) return NULL;
+  while(l < r) {
+    const zu_t m = (l + r) / 2;
+    if(T->e[m].h == ref - 2) return T->e[m].p;
+    if(T->e[m].h < ref - 2) l = m + 1;
+    else r = m;
+  }
+  return NULL;
+}
+
+static int zReplayOp(zgc_t *G, FILE *f, int op, zb_t **buf, zu_t *sz_buf) {
+  // Replay one op. Returns 1 on end, 0 on success, -1 on failure.
+  zu_t a, b, c = 0, k;
+  zu_t *x;
+  zp_t p;
+  switch(op) {
+  case 'A':
+    if(zReadNum(f, &a) < 0 || a == 0) return -1;
+    if(a > *sz_buf) {
+      zb_t *t = (zb_t*) realloc(*buf, a);
+      if(t == NULL) return -1;
+      *buf = t, *sz_buf = a;
+    }
+    for(k = 0; k < a; k++) {
+      if((k & 7) == 0 && (c = (zu_t) fgetc(f)) == (zu_t) EOF) return -1;
+      (*buf)[k] = (c >> (k & 7)) & 1 ? 0 : ZZ_NPTR;
+    }
+    if((x = zAllocLayout(G, a, *buf)) == NULL) return -1;
+    for(k = 0; k < a; k++) {
+      if(!((*buf)[k] & ZZ_NPTR)) x[k] = 0;
+    }
+    return 0;
+  case 'Q':
+    if(zReadNum(f, &a) < 0 || zReadNum(f, &b) < 0) return -1;
+    return zAllocPinned(G, a, b) ? 0 : -1;
+  case 'F':
+    if(zReadNum(f, &a) < 0) return -1;
+    zGCPushFrame(G, (int) a);
+    return 0;
+  case 'f':
+    zGCPopFrame(G);
+    return 0;
+  case 'S':
+    if(zReadNum(f, &a) < 0 || zReadNum(f, &b) < 0 || zReadNum(f, &c) < 0)
+      return -1;
+    if(b >= (zu_t) (a ? G->bot_frame : G->top_frame)->size) return -1;
+    p = zTraceObj(G, c);
+    if(a) zGCSetBotFrame(G, (int) b, (ztag_t) {.p = p}, c == 0);
+    else zGCSetTopFrame(G, (int) b, (ztag_t) {.p = p}, c == 0);
+    return 0;
+  case 'W':
+    if(zReadNum(f, &a) < 0 || zReadNum(f, &b) < 0 || zReadNum(f, &c) < 0)
+      return -1;
+    // Stores into collected objects are ignored
+    if((p = zTraceObj(G, a + 2))) {
+      const zb_t * const s = zStatOf(G, p);
+      // The next object (or the end of gen) begins with SEP
+      for(k = 1; k <= b; k++) if(s[k] & ZZ_SEP) return -1;
+      ((zp_t*) p)[b] = zTraceObj(G, c);
+    }
+    return 0;
+  case 'G': return zRunGC(G) < 0 ? -1 : 0;
+  case 'g': return zFullGC(G) < 0 ? -1 : 0;
+  case 'R':
+    if(zReadNum(f, &a) < 0) return -1;
+    return zGCReserve(G, a) < 0 ? -1 : 0;
+  case 'P':
+    if(zReadNum(f, &a) < 0) return -1;
+    return zGCAddExternalPressure(G, a) < 0 ? -1 : 0;
+  case 'p':
+    if(zReadNum(f, &a) < 0) return -1;
+    zGCSubExternalPressure(G, a);
+    return 0;
+  case 'C':
+    if(zReadNum(f, &a) < 0) return -1;
+    return zAllowCyclicRefGC(G, (int) a - 1) < 0 ? -1 : 0;
+  case 'N': case 'n':
+    if(zReadNum(f, &a) < 0) return -1;
+    if((p = zTraceObj(G, a))) {
+      if(op == 'N') zGCPin(G, p);
+      else zGCUnpin(G, p);
+    }
+    return 0;
+  case 'E': return 1;
+  }
+  return -1;
+}
+
+int zGCReplay(zgc_t *G, FILE *f) {
+  char magic[4];
+  zu_t roots, cyclic, sz_buf = 0;
+  zb_t *buf = NULL;
+  int op, r = 0;
+  if(G->trace) return -1;
+  if(fread(magic, 1, 4, f) != 4 || memcmp(magic, "ZZTR", 4) ||
+    fgetc(f) != ZZ_TRACE_VERSION || fgetc(f) != ZZ_SZPTR ||
+    zReadNum(f, &roots) < 0 || zReadNum(f, &cyclic) < 0) return -1;
+  if(roots > (zu_t) G->bot_frame->size) return -1;
+  if(cyclic) zAllowCyclicRefGC(G, 1);
+  if((G->trace = (ztrace_t*) calloc(1, sizeof(ztrace_t))) == NULL) return -1;
+  G->trace->f = f;
+  G->trace->replay = 1;
+  while(r == 0) {
+    // A trace without the end op is treated as a truncated one
+    if((op = fgetc(f)) == EOF) break;
+    r = zReplayOp(G, f, op, &buf, &sz_buf);
+  }
+  free(buf);
+  free(G->trace->e);
+  free(G->trace);
+  G->trace = NULL;
+  return r < 0 ? -1 : 0;
+}
 
 // For tests
 void zPrintGCStatus(zgc_t *G, zu_t *dst) {
@@ -646,10 +2964,541 @@ ztup_t *zAllocTup(zgc_t *G, zu_t tag, zu_t dim) {
   return t;
 }
 
-zstr_t *zAllocStr(zgc_t *G, zu_t len) {
-  zu_t sz = 2 + len / ZZ_SZPTR;
-  zstr_t *s = (zstr_t*) zAlloc(G, sz, 0);
+zu_t* zAllocWeak(zgc_t *G, zu_t np, zu_t wp) {
+  zu_t *x = zAlloc(G, np, wp);
+  zu_t k;
+  if(x == NULL) return NULL;
+  zb_t * const s = zStatOf(G, x);
+  for(k = np; k < np + wp; k++) {
+    s[k] |= ZZ_WEAK;
+    x[k] = 0;
+  }
+  return x;
+}
+
+zu_t zGCIdHash(zgc_t *G, zp_t p) {
+  return zIdHash(G, p, 1);
+}
+
+zmap_t *zAllocMap(zgc_t *G, zu_t cap) {
+  return zNewMap(G, cap, 0, NULL, 0);
+}
+
+zmap_t *zAllocEph(zgc_t *G, zu_t cap) {
+  return zNewMap(G, cap, 1, NULL, 0);
+}
+
+zp_t zMapGet(zgc_t *G, zmap_t *m, zp_t key) {
+  // Objects without hash cannot be keys
+  const zu_t h = zIdHash(G, key, 0);
+  if(key == NULL || h == 0) return NULL;
+  return zMapKV(m)[(zMapFind(m, key, h) << 1) + 1];
+}
+
+zmap_t *zMapPut(zgc_t *G, zmap_t *m, zp_t key, zp_t val) {
+  zu_t h, i;
+  if(key == NULL || (h = zIdHash(G, key, 1)) == 0) return NULL;
+  i = zMapFind(m, key, h);
+  if(m->hk[i] == 0) {
+    if((m->n + 1) * 4 > m->cap * 3) {
+      // Grow: keep load factor <= 3/4
+      // (Hashes are not changed even if GC runs in allocation)
+      zp_t keep[3] = {m, key, val};
+      const int eph = zStatOf(G, m)[0] & ZZ_EPH;
+      zmap_t *u = zNewMap(G, m->cap << 1, eph, keep, 3);
+      if(u == NULL) return NULL;
+      m = keep[0], key = keep[1], val = keep[2];
+      zp_t * const kv = zMapKV(m), * const ukv = zMapKV(u);
+      for(i = 0; i < m->cap; i++) {
+        if(m->hk[i]) {
+          const zu_t j = zMapFind(u, kv[i << 1], m->hk[i]);
+          u->hk[j] = m->hk[i];
+          ukv[j << 1] = kv[i << 1];
+          ukv[(j << 1) + 1] = kv[(i << 1) + 1];
+      } }
+      u->n = m->n;
+      m = u;
+      i = zMapFind(m, key, h);
+    }
+    m->hk[i] = h;
+    zMapKV(m)[i << 1] = key;
+    m->n++;
+  }
+  zMapKV(m)[(i << 1) + 1] = val;
+  return m;
+}
+
+int zMapDel(zgc_t *G, zmap_t *m, zp_t key) {
+  const zu_t h = zIdHash(G, key, 0);
+  zu_t i;
+  if(key == NULL || h == 0) return 0;
+  i = zMapFind(m, key, h);
+  if(m->hk[i] == 0) return 0;
+  zMapDelAt(m, i);
+  m->n--;
+  return 1;
+}
+
+static zstr_t *zNewStr(zgc_t *G, zu_t len, zp_t *keep, int n) {
+  zstr_t *s = (zstr_t*) zAllocKeep(G, ZZ_STR_WORDS(len), 0, keep, n);
+  if(s == NULL) return NULL;
+  *zStatOf(G, s) |= ZZ_STR;
   s->len = len;
+  s->hash = 0;
   s->c[0] = s->c[len] = '\0';
   return s;
-}
\ No newline at end of file
+}
+
+zstr_t *zAllocStr(zgc_t *G, zu_t len) {
+  return zNewStr(G, len, NULL, 0);
+}
+
+zu_t zStrHash(zstr_t *s) {
+  if(s->hash == 0) s->hash = zHashBytes(s->c, s->len);
+  return s->hash;
+}
+
+static zstr_t *zInternWith(zgc_t *G, const char *c, zu_t len, zstr_t *s) {
+  // Find an interned string, or intern s. (If s is NULL, allocate new one)
+  const zu_t h = s ? zStrHash(s) : zHashBytes(c, len);
+  if(G->syms.n > 0) {
+    const zu_t i = zStabFind(&G->syms, c, len, h);
+    if(G->syms.e[i].h) return (zstr_t*) G->syms.e[i].p;
+  }
+  if(s == NULL) {
+    // GC may run, but the table does not depend on addresses
+    if((s = zAllocStr(G, len)) == NULL) return NULL;
+    memcpy(s->c, c, len);
+    s->hash = h;
+  }
+  return zStabPut(&G->syms, s, h) < 0 ? NULL : s;
+}
+
+zstr_t *zIntern(zgc_t *G, const char *c, zu_t len) {
+  return zInternWith(G, c, len, NULL);
+}
+
+zstr_t *zInternStr(zgc_t *G, zstr_t *s) {
+  return zInternWith(G, s->c, s->len, s);
+}
+// Vector: Unused slots are non-pointer, so GC does not trace them.
+static zvec_t *zNewVec(zgc_t *G, zu_t cap, zp_t *keep, int n) {
+  zu_t k;
+  if(cap < 4) cap = 4;
+  zvec_t *v = (zvec_t*) zAllocKeep(G, 2, cap, keep, n);
+  if(v == NULL) return NULL;
+  v->n = 0, v->cap = cap;
+  zb_t * const s = zStatOf(G, v);
+  for(k = 0; k < cap; k++) {
+    s[2 + k] |= ZZ_NPTR;
+    v->v[k] = NULL;
+  }
+  return v;
+}
+
+zvec_t *zAllocVec(zgc_t *G, zu_t cap) {
+  return zNewVec(G, cap, NULL, 0);
+}
+
+zvec_t *zVecAppend(zgc_t *G, zvec_t *v, const zp_t *ps, zu_t n) {
+  zu_t k;
+  if(v->n + n > v->cap) {
+    // Grow: double capacity. v and ps are kept during allocation,
+    // because GC may move them. (ps may be in the heap)
+    zu_t cap = v->cap << 1;
+    if(cap < v->n + n) cap = v->n + n;
+    zp_t * const keep = (zp_t*) malloc(sizeof(zp_t) * (n + 1));
+    if(keep == NULL) return NULL;
+    keep[0] = v;
+    memcpy(keep + 1, ps, sizeof(zp_t) * n);
+    zvec_t * const u = zNewVec(G, cap, keep, n + 1);
+    if(u == NULL) {
+      free(keep);
+      return NULL;
+    }
+    v = keep[0];
+    zb_t * const s = zStatOf(G, u);
+    for(k = 0; k < v->n + n; k++) s[2 + k] &= ~ZZ_NPTR;
+    memcpy(u->v, v->v, sizeof(zp_t) * v->n);
+    memcpy(u->v + v->n, keep + 1, sizeof(zp_t) * n);
+    u->n = v->n + n;
+    free(keep);
+    return u;
+  }
+  zb_t * const s = zStatOf(G, v);
+  for(k = 0; k < n; k++) {
+    s[2 + v->n] &= ~ZZ_NPTR;
+    v->v[v->n++] = ps[k];
+  }
+  return v;
+}
+
+zvec_t *zVecPush(zgc_t *G, zvec_t *v, zp_t p) {
+  return zVecAppend(G, v, &p, 1);
+}
+
+zp_t zVecPop(zgc_t *G, zvec_t *v) {
+  if(v->n == 0) return NULL;
+  const zp_t p = v->v[--v->n];
+  zStatOf(G, v)[2 + v->n] |= ZZ_NPTR;
+  v->v[v->n] = NULL;
+  return p;
+}
+
+// Buffer: bytes, which is always NUL-terminated as strings.
+static zbuf_t *zNewBuf(zgc_t *G, zu_t cap, zp_t *keep, int n) {
+  if(cap < 16) cap = 16;
+  zbuf_t *b = (zbuf_t*) zAllocKeep(G, 3 + cap / ZZ_SZPTR, 0, keep, n);
+  if(b == NULL) return NULL;
+  b->len = 0, b->cap = cap;
+  b->c[0] = '\0';
+  return b;
+}
+
+zbuf_t *zAllocBuf(zgc_t *G, zu_t cap) {
+  return zNewBuf(G, cap, NULL, 0);
+}
+
+zbuf_t *zBufAppend(zgc_t *G, zbuf_t *b, const char *c, zu_t n) {
+  if(b->len + n > b->cap) {
+    // Grow: double capacity. c is copied first because it may be in the heap.
+    zu_t cap = b->cap << 1;
+    if(cap < b->len + n) cap = b->len + n;
+    char * const tmp = (char*) malloc(n + 1);
+    if(tmp == NULL) return NULL;
+    memcpy(tmp, c, n);
+    zp_t keep[1] = {b};
+    zbuf_t * const u = zNewBuf(G, cap, keep, 1);
+    if(u == NULL) {
+      free(tmp);
+      return NULL;
+    }
+    b = keep[0];
+    memcpy(u->c, b->c, b->len);
+    memcpy(u->c + b->len, tmp, n);
+    u->len = b->len + n;
+    u->c[u->len] = '\0';
+    free(tmp);
+    return u;
+  }
+  memmove(b->c + b->len, c, n);
+  b->len += n;
+  b->c[b->len] = '\0';
+  return b;
+}
+
+zbuf_t *zBufPush(zgc_t *G, zbuf_t *b, char c) {
+  return zBufAppend(G, b, &c, 1);
+}
+
+zstr_t *zBufToStr(zgc_t *G, zbuf_t *b) {
+  zp_t keep[1] = {b};
+  zstr_t * const s = zNewStr(G, b->len, keep, 1);
+  if(s == NULL) return NULL;
+  b = keep[0];
+  memcpy(s->c, b->c, b->len);
+  return s;
+}
+
+// HAMT: Each node is a tuple, whose tag has two bitmaps of ZZ_HAMT_W bits.
+// (data map in lower bits, node map in upper bits) Slots are key/value pairs
+// of data map, and then children of node map, both in the order of bits.
+// When all hash bits are used, a node is a list of pairs, whose tag is # of
+// pairs. Updates copy the path from the root. Nodes of the path are allocated
+// after reservation, so GC never runs while building the path.
+#define ZZ_HAMT_BITS (ZZ_SZPTR == 8 ? 5 : 4)
+#define ZZ_HAMT_W (1 << ZZ_HAMT_BITS)
+#define ZZ_HAMT_HBITS (ZZ_SZPTR * 8)
+#define zHamtDM(t) ((t)->tag.u & (((zu_t) 1 << ZZ_HAMT_W) - 1))
+#define zHamtNM(t) ((t)->tag.u >> ZZ_HAMT_W)
+#define zHamtChunk(h, sh) (((h) >> (sh)) & (ZZ_HAMT_W - 1))
+
+static int zBitCount(zu_t x) {
+#if defined(__GNUC__)
+  return __builtin_popcountll((unsigned long long) x);
+#else
+  int n = 0;
+  for(; x; x &= x - 1) n++;
+  return n;
+#endif
+}
+
+static zu_t zHamtDim(ztup_t *t, int sh) {
+  if(sh >= ZZ_HAMT_HBITS) return 2 * t->tag.u;
+  return 2 * zBitCount(zHamtDM(t)) + zBitCount(zHamtNM(t));
+}
+
+static ztup_t *zHamtCopy(zgc_t *G, ztup_t *t, int sh, zu_t tag,
+    zu_t at, zu_t del, zu_t ins) {
+  // Copy t with a new tag, removing del slots at at and inserting ins
+  // uninitialized slots at at
+  const zu_t dim = zHamtDim(t, sh);
+  ztup_t * const u = zAllocTup(G, tag, dim - del + ins);
+  memcpy(u->slots, t->slots, sizeof(zp_t) * at);
+  memcpy(u->slots + at + ins, t->slots + at + del,
+    sizeof(zp_t) * (dim - at - del));
+  return u;
+}
+
+static ztup_t *zHamtMerge(zgc_t *G, int sh, zp_t k1, zp_t v1, zu_t h1,
+    zp_t k2, zp_t v2, zu_t h2) {
+  // Make a node of two pairs
+  ztup_t *t;
+  if(sh >= ZZ_HAMT_HBITS) {
+    t = zAllocTup(G, 2, 4);
+  } else {
+    const zu_t c1 = zHamtChunk(h1, sh), c2 = zHamtChunk(h2, sh);
+    if(c1 == c2) {
+      t = zAllocTup(G, ((zu_t) 1 << c1) << ZZ_HAMT_W, 1);
+      t->slots[0] = zHamtMerge(G, sh + ZZ_HAMT_BITS, k1, v1, h1, k2, v2, h2);
+      return t;
+    }
+    t = zAllocTup(G, ((zu_t) 1 << c1) | ((zu_t) 1 << c2), 4);
+    if(c1 > c2) {
+      zp_t x = k1; k1 = k2; k2 = x;
+      x = v1; v1 = v2; v2 = x;
+  } }
+  t->slots[0] = k1, t->slots[1] = v1;
+  t->slots[2] = k2, t->slots[3] = v2;
+  return t;
+}
+
+static zu_t zHamtCost(zgc_t *G, ztup_t *t, zp_t key, zu_t h) {
+  // Upper bound of words to be allocated for updating key
+  zu_t cost = 0;
+  int sh;
+  for(sh = 0; ; sh += ZZ_HAMT_BITS) {
+    cost += zHamtDim(t, sh) + 3;
+    if(sh >= ZZ_HAMT_HBITS) return cost;
+    const zu_t bit = (zu_t) 1 << zHamtChunk(h, sh);
+    if(zHamtNM(t) & bit) {
+      t = t->slots[2 * zBitCount(zHamtDM(t)) +
+        zBitCount(zHamtNM(t) & (bit - 1))];
+    } else if(zHamtDM(t) & bit) {
+      // Pairs may be merged into new nodes (3 words for each level)
+      return cost + (ZZ_HAMT_HBITS / ZZ_HAMT_BITS + 2) * 3 + 5;
+    } else return cost;
+} }
+
+static ztup_t *zHamtPutAt(zgc_t *G, ztup_t *t, int sh, zp_t key, zp_t val,
+    zu_t h) {
+  // Return new node containing key, or t if nothing is changed
+  zu_t i;
+  if(sh >= ZZ_HAMT_HBITS) {
+    for(i = 0; i < t->tag.u; i++) {
+      if(t->slots[2 * i] == (ztup_t*) key) {
+        if(t->slots[2 * i + 1] == (ztup_t*) val) return t;
+        ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u, 0, 0, 0);
+        u->slots[2 * i + 1] = val;
+        return u;
+    } }
+    ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u + 1, 2 * i, 0, 2);
+    u->slots[2 * i] = key, u->slots[2 * i + 1] = val;
+    return u;
+  }
+  const zu_t bit = (zu_t) 1 << zHamtChunk(h, sh);
+  const zu_t dm = zHamtDM(t), nm = zHamtNM(t);
+  const zu_t nd = 2 * zBitCount(dm);
+  if(nm & bit) {
+    i = nd + zBitCount(nm & (bit - 1));
+    ztup_t * const c = zHamtPutAt(G, t->slots[i], sh + ZZ_HAMT_BITS,
+      key, val, h);
+    if(c == t->slots[i]) return t;
+    ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u, 0, 0, 0);
+    u->slots[i] = c;
+    return u;
+  }
+  i = 2 * zBitCount(dm & (bit - 1));
+  if(dm & bit) {
+    const zp_t k = t->slots[i], v = t->slots[i + 1];
+    if(k == key) {
+      if(v == val) return t;
+      ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u, 0, 0, 0);
+      u->slots[i + 1] = val;
+      return u;
+    }
+    // Move the pair into a new child
+    ztup_t * const c = zHamtMerge(G, sh + ZZ_HAMT_BITS,
+      k, v, zIdHash(G, k, 0), key, val, h);
+    const zu_t dim = nd + zBitCount(nm);
+    const zu_t j = nd - 2 + zBitCount(nm & (bit - 1));
+    ztup_t * const u = zAllocTup(G,
+      (dm ^ bit) | ((nm | bit) << ZZ_HAMT_W), dim - 1);
+    memcpy(u->slots, t->slots, sizeof(zp_t) * i);
+    memcpy(u->slots + i, t->slots + i + 2, sizeof(zp_t) * (j - i));
+    u->slots[j] = c;
+    memcpy(u->slots + j + 1, t->slots + j + 2, sizeof(zp_t) * (dim - j - 2));
+    return u;
+  }
+  ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u | bit, i, 0, 2);
+  u->slots[i] = key, u->slots[i + 1] = val;
+  return u;
+}
+
+static ztup_t *zHamtDelAt(zgc_t *G, ztup_t *t, int sh, zp_t key, zu_t h) {
+  // Return new node without key, or t if key is not found.
+  // A child with a single pair is inlined into its parent.
+  zu_t i;
+  if(sh >= ZZ_HAMT_HBITS) {
+    for(i = 0; i < t->tag.u; i++) {
+      if(t->slots[2 * i] == (ztup_t*) key)
+        return zHamtCopy(G, t, sh, t->tag.u - 1, 2 * i, 2, 0);
+    }
+    return t;
+  }
+  const zu_t bit = (zu_t) 1 << zHamtChunk(h, sh);
+  const zu_t dm = zHamtDM(t), nm = zHamtNM(t);
+  const zu_t nd = 2 * zBitCount(dm);
+  if(nm & bit) {
+    const int csh = sh + ZZ_HAMT_BITS;
+    i = nd + zBitCount(nm & (bit - 1));
+    ztup_t * const c = zHamtDelAt(G, t->slots[i], csh, key, h);
+    if(c == t->slots[i]) return t;
+    if(zHamtDim(c, csh) == 2 &&
+        (csh >= ZZ_HAMT_HBITS || zHamtNM(c) == 0)) {
+      // Inline the last pair of the child
+      const zu_t dim = nd + zBitCount(nm);
+      const zu_t j = 2 * zBitCount(dm & (bit - 1));
+      ztup_t * const u = zAllocTup(G,
+        (dm | bit) | ((nm ^ bit) << ZZ_HAMT_W), dim + 1);
+      memcpy(u->slots, t->slots, sizeof(zp_t) * j);
+      u->slots[j] = c->slots[0], u->slots[j + 1] = c->slots[1];
+      memcpy(u->slots + j + 2, t->slots + j, sizeof(zp_t) * (i - j));
+      memcpy(u->slots + i + 2, t->slots + i + 1, sizeof(zp_t) * (dim - i - 1));
+      return u;
+    }
+    ztup_t * const u = zHamtCopy(G, t, sh, t->tag.u, 0, 0, 0);
+    u->slots[i] = c;
+    return u;
+  }
+  i = 2 * zBitCount(dm & (bit - 1));
+  if(!(dm & bit) || t->slots[i] != (ztup_t*) key) return t;
+  return zHamtCopy(G, t, sh, t->tag.u ^ bit, i, 2, 0);
+}
+
+static int zHamtEachAt(ztup_t *t, int sh, zhamtfn_t fn, zp_t ud) {
+  const zu_t dim = zHamtDim(t, sh);
+  const zu_t nd = sh >= ZZ_HAMT_HBITS ? dim : 2 * zBitCount(zHamtDM(t));
+  zu_t i;
+  int r;
+  for(i = 0; i < nd; i += 2)
+    if((r = fn(t->slots[i], t->slots[i + 1], ud))) return r;
+  for(; i < dim; i++)
+    if((r = zHamtEachAt(t->slots[i], sh + ZZ_HAMT_BITS, fn, ud))) return r;
+  return 0;
+}
+
+static ztup_t *zHamtUpdate(zgc_t *G, ztup_t *t, zp_t key, zp_t val, int del) {
+  // Reserve words for the path, and put (or delete) key
+  zp_t keep[3] = {t, key, val};
+  const zu_t h = zIdHash(G, key, !del);
+  if(key == NULL || h == 0) return del ? t : NULL;
+  if(zReserveKeep(G, zHamtCost(G, t, key, h), keep, 3) < 0) return NULL;
+  t = keep[0], key = keep[1], val = keep[2];
+  t = del ? zHamtDelAt(G, t, 0, key, h) : zHamtPutAt(G, t, 0, key, val, h);
+  G->reserve_lim = (zu_t) -1;
+  return t;
+}
+
+ztup_t *zAllocHamt(zgc_t *G) {
+  return zAllocTup(G, 0, 0);
+}
+
+zp_t zHamtGet(zgc_t *G, ztup_t *t, zp_t key) {
+  const zu_t h = zIdHash(G, key, 0);
+  zu_t i;
+  int sh;
+  if(key == NULL || h == 0) return NULL;
+  for(sh = 0; sh < ZZ_HAMT_HBITS; sh += ZZ_HAMT_BITS) {
+    const zu_t bit = (zu_t) 1 << zHamtChunk(h, sh);
+    const zu_t dm = zHamtDM(t), nm = zHamtNM(t);
+    if(nm & bit) {
+      t = t->slots[2 * zBitCount(dm) + zBitCount(nm & (bit - 1))];
+    } else {
+      i = 2 * zBitCount(dm & (bit - 1));
+      return (dm & bit) && t->slots[i] == (ztup_t*) key ?
+        t->slots[i + 1] : NULL;
+  } }
+  for(i = 0; i < t->tag.u; i++)
+    if(t->slots[2 * i] == (ztup_t*) key) return t->slots[2 * i + 1];
+  return NULL;
+}
+
+ztup_t *zHamtPut(zgc_t *G, ztup_t *t, zp_t key, zp_t val) {
+  return zHamtUpdate(G, t, key, val, 0);
+}
+
+ztup_t *zHamtDel(zgc_t *G, ztup_t *t, zp_t key) {
+  return zHamtUpdate(G, t, key, NULL, 1);
+}
+
+int zHamtEach(ztup_t *t, zhamtfn_t fn, zp_t ud) {
+  return zHamtEachAt(t, 0, fn, ud);
+}
+
+static int zHamtCountFn(zp_t key, zp_t val, zp_t ud) {
+  (*(zu_t*) ud)++;
+  return 0;
+}
+
+zu_t zHamtCount(ztup_t *t) {
+  zu_t n = 0;
+  zHamtEachAt(t, 0, zHamtCountFn, &n);
+  return n;
+}
+
+// Immediate floats: a double is rotated to put 3 upper bits of exponent into
+// low bits, and it is immediate if the bits are 011 or 100. (same as flonum of
+// CRuby) 0.0 takes the unused code of 0x3000000000000000. Other floats are
+// boxed.
+zp_t zFlo(zgc_t *G, zf_t f) {
+  ztag_t t;
+  t.f = f;
+#if ZZ_SZPTR == 8
+  const int e = (int) ((t.u >> 60) & 7);
+  if(t.u != (zu_t) 0x3000000000000000ull && ((e - 3) & ~1) == 0)
+    return (zp_t) ((((t.u << 3) | (t.u >> 61)) & ~(zu_t) 1) | 2);
+  if(t.u == 0) return (zp_t) (zu_t) 0x8000000000000002ull;
+#endif
+  zu_t * const x = zAlloc(G, 1, 0);
+  if(x == NULL) return NULL;
+  *x = t.u;
+  return x;
+}
+
+zf_t zFloOf(zp_t v) {
+  ztag_t t;
+#if ZZ_SZPTR == 8
+  if(zIsFlo(v)) {
+    const zu_t x = (zu_t) v;
+    if(x == (zu_t) 0x8000000000000002ull) return 0.0;
+    const zu_t y = (2 - (x >> 63)) | (x & ~ZZ_IMM_MASK);
+    t.u = (y >> 3) | (y << 61);
+    return t.f;
+  }
+#endif
+  t.u = *(zu_t*) v;
+  return t.f;
+}
+
+// Compressed references: a word has two 32-bit references
+zu_t* zAllocCRef(zgc_t *G, zu_t np, zu_t cp) {
+  zu_t *x, k;
+  if(G->arena == NULL) return NULL;
+  if((x = zAlloc(G, np, cp)) == NULL) return NULL;
+  zb_t * const s = zStatOf(G, x);
+  for(k = np; k < np + cp; k++) {
+    s[k] |= ZZ_NPTR | ZZ_CREF;
+    x[k] = 0;
+  }
+  return x;
+}
+
+zp_t zCRefGet(zgc_t *G, zu_t *x, zu_t i) {
+  const uint32_t r = ((uint32_t*) x)[i];
+  return r ? (zp_t) (G->arena->base + r) : NULL;
+}
+
+void zCRefSet(zgc_t *G, zu_t *x, zu_t i, zp_t p) {
+  ((uint32_t*) x)[i] = p ? (uint32_t) ((zu_t*) p - G->arena->base) : 0;
+}
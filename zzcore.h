@@ -3,9 +3,14 @@
 #ifndef __L_ZZCORE_H__
 #define __L_ZZCORE_H__
 
+#include <stdio.h>
 #include <stdint.h>
 #include <limits.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // PTR size types
 typedef uintptr_t zu_t;
 typedef uint8_t zb_t;
@@ -30,19 +35,87 @@ typedef union ztag {
   zb_t b[0];
 } ztag_t;
 
+// Immediate values: Values in pointer slots whose low 2 bits are not 0 are
+// not references, and GC never traces or updates them. (Objects are aligned)
+// - Integer: ...1, (# of bits in pointer - 1)-bit signed integer
+// - Float: ...10, floats in the common range in 64-bit (See zFlo)
+#define ZZ_IMM_MASK ((zu_t) 3)
+#define zIsImm(v) (((zu_t) (v)) & ZZ_IMM_MASK)
+#define zIsInt(v) (((zu_t) (v)) & 1)
+#define zIsFlo(v) ((((zu_t) (v)) & ZZ_IMM_MASK) == 2)
+#define zInt(i) ((zp_t) (((zu_t) (i) << 1) | 1))
+#define zIntOf(v) (((zi_t) (zu_t) (v)) >> 1)
+#define ZZ_INT_MAX (INTPTR_MAX >> 1)
+#define ZZ_INT_MIN (-ZZ_INT_MAX - 1)
+
 typedef struct zgc zgc_t;
+// Finalizer: called with a collected object during GC. Non-pointer part of
+// the object is valid only in the call. It must not allocate, run GC or set
+// finalizers.
+typedef void (*zfinalizer_t)(zgc_t*, zp_t /* object */, zp_t /* user data */);
 
 // -- GC APIs
+// Minor heap size 0 means the default size.
 zgc_t* zNewGC(zu_t /* root size */, zu_t /* minor heap size */);
+// Cache-aware GC: The minor heap fits in a half of the data cache of the level
+// (1 to ZZ_CACHE_LEVELS), read from sysfs at creation. (Linux only, otherwise
+// or if unknown, the default size) Returns NULL for an invalid level.
+#define ZZ_CACHE_LEVELS 4
+zgc_t* zNewGCCache(zu_t /* root size */, int /* cache level */);
+// Compressed GC: The whole heap is in a reserved range of the given words
+// (< 2^32), and compressed references (zAllocCRef) can be used.
+// Returns NULL if the range cannot be reserved.
+zgc_t* zNewCRefGC(zu_t /* root size */, zu_t /* minor heap size */,
+  zu_t /* max heap size */);
 void zDelGC(zgc_t*);
+// Size of the data (or unified) cache of the level in bytes, 0 if unknown
+zu_t zGCCacheBytes(int /* level */);
 
 // Allocation
 zu_t* zAlloc(zgc_t*, zu_t /* # of non-pointer */, zu_t /* # of pointer */);
+// Shape: Registered object layout, where pointer and non-pointer words may be
+// interleaved. i-th word is a pointer if i-th bit of mask is set. (mask is
+// an array of words, ceil(size / bits of word)) Register returns shape id,
+// or -1 on failure. Allocation by shape only copies the precomputed layout.
+int zRegisterShape(zgc_t*, zu_t /* # of words */, const zu_t* /* mask */);
+zu_t* zAllocShape(zgc_t*, int /* shape id */); // NULL for invalid id
+// Allocation by layout: layout[i] is 1 if i-th word is non-pointer, otherwise
+// 0. (It is same as a shape, without registration)
+zu_t* zAllocLayout(zgc_t*, zu_t /* # of words */, const zb_t* /* layout */);
+// Reserve: Make sure that following allocations, whose total size is less
+// than or equal to the given words, never run GC. (It may run GC once before
+// return.) Returns 1 if no GC was needed, 0 if GC ran, -1 on failure.
+int zGCReserve(zgc_t*, zu_t /* # of words */);
+// Pinned allocation: Pinned objects are never moved, but traced and freed as
+// normal objects. Pin count keeps a pinned object alive even if it is not
+// reachable. (e.g. buffer of pending I/O) Pin/Unpin return the new pin count,
+// or -1 if the pointer is not a pinned object. Dead pinned objects are freed
+// by full GC, which pinned allocation runs when pinned gens grow too much.
+zu_t* zAllocPinned(zgc_t*, zu_t /* # of non-pointer */, zu_t /* # of pointer */);
+int zGCPin(zgc_t*, zp_t);
+int zGCUnpin(zgc_t*, zp_t);
+
+// External memory: Tell GC the amount of memory held by GC objects outside of
+// GC heap. (e.g. malloc'd buffers) External memory triggers GC like heap
+// allocations, so it may run GC. Return value is same as zRunGC.
+int zGCAddExternalPressure(zgc_t*, zu_t /* bytes */);
+void zGCSubExternalPressure(zgc_t*, zu_t /* bytes */);
+// Finalizer: Call fn when the object is collected. (e.g. to release external
+// memory) Returns 0 on success, -1 on failure.
+int zGCSetFinalizer(zgc_t*, zp_t, zfinalizer_t, zp_t /* user data */);
 
 // RunGC: Make an empty space in minor heap
 int zRunGC(zgc_t*);
 // FullGC: Arrange minor and all major heap
 int zFullGC(zgc_t*);
+// Idle: Do GC work which fits before the deadline (in ns of zGCNowNs), so that
+// collections run between requests instead of during them. In the order:
+// a minor GC if the minor heap is 1/4 allocated, a full GC if major gens grew
+// halfway to the next full GC, and merges of gens (if enabled). Each is run
+// only if its pause, estimated by recent pauses, fits. Returns 1 if some work
+// is pending (call again in the next idle time), 0 if not, -1 on failure.
+int zGCIdle(zgc_t*, uint64_t /* deadline in ns */);
+uint64_t zGCNowNs(void); // monotonic clock in ns
 
 // GC root frames
 void zGCPushFrame(zgc_t*, int /* size */);
@@ -53,9 +126,36 @@ ztag_t zGCTopFrame(zgc_t*, int /* idx */);
 ztag_t zGCBotFrame(zgc_t*, int /* idx */);
 void zGCSetTopFrame(zgc_t*, int /* idx */, ztag_t /*v*/, int /*is_not_ptr*/);
 void zGCSetBotFrame(zgc_t*, int /* idx */, ztag_t /*v*/, int /*is_not_ptr*/);
+// Address of a pointer slot, which is updated by GC while the frame is alive
+ztag_t* zGCTopFrameSlot(zgc_t*, int /* idx */);
+ztag_t* zGCBotFrameSlot(zgc_t*, int /* idx */);
 
 // Option setter
 void zSetMajorMinSizeGC(zgc_t*, zu_t /* min major heap size */);
+// Generation consolidation: If the max is set (default 0, disabled), after a
+// minor GC, adjacent major gens are merged into one if they are sparse (less
+// than 25 percent allocated), or if there are more major gens than the max.
+// Merging is a partial collection, counted in stats.merge.
+void zSetMaxGensGC(zgc_t*, int /* max # of major gens */);
+// Ergonomics: Instead of fixed factors, choose the minor heap size, new gen
+// sizes and removal of empty gens after each GC to meet a goal.
+// - GC_FRACTION: GC time / total time <= value (e.g. 0.05), by measured GC
+//   time between collections and minor survival. Old gens are fully
+//   collected when they grow by the chosen factor.
+// - MAX_HEAP: total heap words <= value (hard limit), by a minor heap of
+//   value / 8, tight new gens, and full GCs near the limit. The limit may be
+//   exceeded only while alive objects do not fit.
+// NONE restores the fixed policy. Returns 0 on success, -1 on invalid goal.
+#define ZZ_GOAL_NONE 0
+#define ZZ_GOAL_GC_FRACTION 1
+#define ZZ_GOAL_MAX_HEAP 2
+int zGCSetGoal(zgc_t*, int /* ZZ_GOAL_* */, double /* value */);
+// String deduplication: When strings are moved into major gens, strings with
+// the same contents are merged into one. It is useful when many strings are
+// alive for a long time. Do not enable it if strings are modified after
+// allocation or compared by addresses. (Strings with identity hashes are
+// excluded.)
+void zSetStrDedupGC(zgc_t*, int);
 int zAllowCyclicRefGC(zgc_t*, int);
 
 // GC Information
@@ -65,6 +165,125 @@ zu_t zGCNGen(zgc_t*); // return # of generations
 zu_t zGCReservedSlots(zgc_t*, int /* idx of gen, -1 for whole slots */);
 zu_t zGCLeftSlots(zgc_t*, int /* idx of gen, -1 for whold slots */);
 zu_t zGCAllocatedSlots(zgc_t*, int /* idx of gen, -1 for whold slots */);
+zu_t zGCExternalBytes(zgc_t*); // return # of bytes of external memory
+
+// GC Statistics
+// Pause histogram: hist[0] counts pauses < 1us, hist[k] counts pauses in
+// [2^(k-1), 2^k) us, and the last bucket counts all longer pauses.
+#define ZZ_STAT_HIST 24
+// Survival is recorded for gens[0..ZZ_STAT_GENS-2], and the last entry is
+// for all older gens.
+#define ZZ_STAT_GENS 8
+// Hardware counters (see zGCSetPerfCounters)
+#define ZZ_PERF_CYCLES 0
+#define ZZ_PERF_INSTRUCTIONS 1
+#define ZZ_PERF_LLC_MISSES 2 // last-level cache read misses
+#define ZZ_PERF_DTLB_MISSES 3 // data TLB read misses
+#define ZZ_PERF_N 4
+#define ZZ_PERF_PHASES 7 // indexed by ZZ_EV_*
+typedef struct zgckstat { // statistics of one kind of collection
+  zu_t count; // # of collections
+  uint64_t pause_ns, max_pause_ns; // cumulative & max pause time
+  zu_t marked; // # of words marked alive
+  zu_t copied; // # of words copied
+  zu_t promoted; // # of words copied out of the minor gen
+  zu_t gens_created, gens_deleted;
+  // Words allocated in each gen at the beginning of collections and words of
+  // them survived, only for collected (moved) gens
+  zu_t gen_allocated[ZZ_STAT_GENS], gen_survived[ZZ_STAT_GENS];
+  double survival[ZZ_STAT_GENS]; // survived / allocated (0 if not collected)
+  zu_t hist[ZZ_STAT_HIST];
+  // Counters in each phase, where [ZZ_EV_GC] is for whole collections
+  uint64_t perf[ZZ_PERF_PHASES][ZZ_PERF_N];
+} zgckstat_t;
+typedef struct zgcstats {
+  zgckstat_t minor; // zRunGC (including GCs triggered by allocation)
+  zgckstat_t full; // zFullGC
+  zgckstat_t merge; // consolidation of gens (see zSetMaxGensGC)
+  zu_t large_gens; // # of gens created for large objects
+  zu_t minor_resizes; // # of minor heap resizes by the goal (see zGCSetGoal)
+  zu_t merged_gens; // # of gens merged by consolidation (see zSetMaxGensGC)
+  zu_t idle_gcs; // # of collections run by zGCIdle
+  double gc_fraction; // GC time / total time, weighted toward recent GCs
+} zgcstats_t;
+void zGCGetStats(zgc_t*, zgcstats_t*);
+void zGCResetStats(zgc_t*);
+// Hardware counters: Count cycles, instructions, LLC misses and dTLB misses
+// of each GC phase by perf_event_open (Linux only), into stats. It costs a
+// few system calls per phase, so it is disabled by default. Returns a mask of
+// opened counters (i-th bit for ZZ_PERF_i), which is 0 if unavailable.
+int zGCSetPerfCounters(zgc_t*, int /* on */);
+const char* zGCPerfName(int /* ZZ_PERF_* */);
+
+// Allocation sampling: Sample an allocation every N words on average (Poisson
+// sampling), and record its site and whether it is promoted. The site is a
+// backtrace (if available), or the site id set by zGCSetAllocSite.
+#define ZZ_PROF_ALLOC 0 // all sampled objects
+#define ZZ_PROF_LIVE 1 // sampled objects not collected yet
+#define ZZ_PROF_PROMOTED 2 // sampled objects survived the minor gen
+#define ZZ_PROF_PREMATURE 3 // promoted, but collected later
+void zGCSetAllocSampling(zgc_t*, zu_t /* mean interval in words, 0 to off */);
+// Site id for following allocations (0 to use backtraces)
+void zGCSetAllocSite(zgc_t*, zu_t /* site id */);
+// Write a profile of ZZ_PROF_* to fp, in the legacy heap profile format of
+// pprof. (Addresses in stacks are site ids, if they are given.)
+// Returns 0 on success, -1 on failure.
+int zGCWriteAllocProfile(zgc_t*, FILE*, int /* kind */);
+void zGCResetAllocProfile(zgc_t*);
+
+// Heap dump: Mark all gens, and write every alive object (address, gen, size,
+// pointer layout, the first word as a tag) with its references and roots in a
+// compact binary format. (See zzcore.c for the format, and tools/zzheap.c
+// for analysis) Returns 0 on success, -1 on failure.
+#define ZZ_DUMP_VERSION 1
+#define ZZ_DUMP_PINNED 0x01 // object in a pinned gen
+#define ZZ_DUMP_STR 0x02 // string
+#define ZZ_DUMP_EPH 0x04 // ephemeron table
+#define ZZ_DUMP_WEAK 0x08 // object has weak references
+#define ZZ_DUMP_CREF 0x10 // object has compressed references
+int zGCHeapDump(zgc_t*, FILE*);
+
+// GC Events: A hook is called at the beginning and the end of each collection
+// and its phases. Timestamps are in ns of CLOCK_MONOTONIC (if available).
+// A hook must not allocate or run GC.
+#define ZZ_EV_GC 0 // whole collection, work = words copied
+#define ZZ_EV_MARK 1 // marking, work = words marked
+#define ZZ_EV_COPY 2 // copying, work = words copied
+#define ZZ_EV_UPDATE 3 // updating pointers of heaps & roots, work = words scanned
+#define ZZ_EV_WEAK 4 // finalizers & weak tables, work = # of entries
+#define ZZ_EV_CLEAN 5 // cleaning marks & sweeping pinned gens
+#define ZZ_EV_REDUCE 6 // removing empty gens, work = # of deleted gens
+typedef struct zgcevent {
+  int kind; // ZZ_EV_*
+  int begin; // 1 at the beginning, 0 at the end
+  int full; // 1 if it is in zFullGC
+  uint64_t ts; // timestamp in ns
+  zu_t work; // work done in the phase (only at the end)
+} zgcevent_t;
+typedef void (*zgchook_t)(zgc_t*, const zgcevent_t*, zp_t /* user data */);
+// Set a hook (NULL to remove)
+void zGCSetHook(zgc_t*, zgchook_t, zp_t /* user data */);
+const char* zGCEventName(int /* kind */);
+// Trace sink: Write events to fp in Chrome trace-event JSON (array format),
+// which can be opened by chrome://tracing or Perfetto. It replaces the hook.
+// Call zGCTraceEnd to close the array and remove the hook. (fp is not closed)
+void zGCTraceJSON(zgc_t*, FILE*);
+void zGCTraceEnd(zgc_t*);
+
+// Allocation trace: Record allocations and mutator ops (root frames, pins,
+// explicit GCs, reservations, external memory, and pointer stores by
+// zGCSetRef) into fp, in a compact binary format. Replay runs the same ops on
+// another GC, e.g. to compare GC options on a production workload offline.
+// Only recorded stores make edges in replay, so other stores (e.g. through
+// frame slot addresses, or inside of helpers) are lost, and objects are
+// replayed by layouts only. (flags such as weak are lost)
+// fp is not closed. Functions return 0 on success, -1 on failure.
+#define ZZ_TRACE_VERSION 1
+void zGCSetRef(zgc_t*, zp_t /* object */, zu_t /* idx */, zp_t /* value */);
+int zGCRecordAllocs(zgc_t*, FILE*);
+int zGCRecordEnd(zgc_t*);
+// Replay requires the bottom frame at least as large as the recorded one.
+int zGCReplay(zgc_t*, FILE*);
 
 // For tests
 void zPrintGCStatus(zgc_t*, zu_t *dst);
@@ -78,11 +297,120 @@ typedef struct ztup {
 
 ztup_t *zAllocTup(zgc_t*, zu_t /* tag */, zu_t /* dim */);
 
+// String layout: len, hash, then NUL-terminated c. (Layout break: hash was
+// added after len, so a string is a word larger than before, and c moved.)
+// Allocate strings by zAllocStr. A string allocated manually (e.g. by zAlloc)
+// must have ZZ_STR_WORDS(len) non-pointer words, with hash = 0.
 typedef struct zstr {
   zu_t len;
+  zu_t hash; // cached hash of c, 0 if not computed
   char c[1];
 } zstr_t;
+#define ZZ_STR_WORDS(len) (3 + (len) / ZZ_SZPTR) // words of a string of len
 
 zstr_t *zAllocStr(zgc_t*, zu_t /* len */);
+// Hash of contents. It is cached, so set hash to 0 after modifying contents.
+zu_t zStrHash(zstr_t*);
+// Interning: Return the unique string with the same contents. Interned strings
+// can be compared by pointers. Symbol table holds strings weakly, so unused
+// symbols are collected. Interned strings must not be modified.
+zstr_t *zIntern(zgc_t*, const char*, zu_t /* len */);
+// Intern s itself if there is no string with the same contents.
+zstr_t *zInternStr(zgc_t*, zstr_t*);
+
+// Float: Return an immediate float if possible, or a boxed float (1 word
+// non-pointer object). Boxing may run GC. FloOf accepts both.
+zp_t zFlo(zgc_t*, zf_t);
+zf_t zFloOf(zp_t);
+
+// Compressed references: Only for a compressed GC. An object has np
+// non-pointer words and cp words of compressed references, and each word
+// contains 2 references. (32-bit offsets) Get/Set i-th reference from the
+// first compressed word. References must be NULL or objects of the GC.
+zu_t* zAllocCRef(zgc_t*, zu_t /* # of non-pointer */, zu_t /* # of words */);
+zp_t zCRefGet(zgc_t*, zu_t*, zu_t /* idx */);
+void zCRefSet(zgc_t*, zu_t*, zu_t /* idx */, zp_t);
+
+// Vector: Growable array of pointers. Append/Push may grow the vector (and
+// run GC), so they return the vector to be used. (NULL on failure)
+// Only v[0..n) are traced by GC. Growth doubles capacity, thus appending is
+// amortized O(1). As other mutable objects, an old vector may refer younger
+// objects, which requires zAllowCyclicRefGC.
+typedef struct zvec {
+  zu_t n; // # of elements
+  zu_t cap; // capacity
+  zp_t v[0];
+} zvec_t;
+
+zvec_t *zAllocVec(zgc_t*, zu_t /* capacity */);
+zvec_t *zVecAppend(zgc_t*, zvec_t*, const zp_t*, zu_t /* n */);
+zvec_t *zVecPush(zgc_t*, zvec_t*, zp_t);
+zp_t zVecPop(zgc_t*, zvec_t*); // NULL if empty
+
+// Buffer: String builder. As vectors, Append/Push return the buffer to be
+// used. c is always NUL-terminated. ToStr copies contents into a new string.
+typedef struct zbuf {
+  zu_t len;
+  zu_t cap; // capacity in bytes, except NUL
+  char c[1];
+} zbuf_t;
+
+zbuf_t *zAllocBuf(zgc_t*, zu_t /* capacity */);
+zbuf_t *zBufAppend(zgc_t*, zbuf_t*, const char*, zu_t /* len */);
+zbuf_t *zBufPush(zgc_t*, zbuf_t*, char);
+zstr_t *zBufToStr(zgc_t*, zbuf_t*);
+
+// Weak object: Pointer part is weak, which does not keep objects alive.
+// GC sets weak pointers to NULL when their objects are collected.
+// (e.g. Weak reference cell is zAllocWeak(G, 0, 1))
+zu_t* zAllocWeak(zgc_t*, zu_t /* # of non-pointer */, zu_t /* # of weak */);
+
+// Identity hash: Stable hash of an object, which is not changed by GC.
+// Non-object values (e.g. integers) are hashed by their values.
+zu_t zGCIdHash(zgc_t*, zp_t);
+
+// Map: Hash map by object identity. Key must not be NULL, and Get returns NULL
+// if there is no key. Put may grow the map (and run GC), so it returns the map
+// to be used. (NULL on failure) Hashes are stored in the map, thus maps are
+// never rehashed after GC.
+// hk contains hashes (0 for empty entries) and key/value pairs.
+typedef struct zmap {
+  zu_t n; // # of entries
+  zu_t cap; // capacity, power of 2
+  zu_t hk[0]; // hashes[cap], and then key/value pairs[cap * 2]
+} zmap_t;
+#define zMapKV(m) ((zp_t*) ((m)->hk + (m)->cap))
+
+zmap_t *zAllocMap(zgc_t*, zu_t /* capacity */);
+zp_t zMapGet(zgc_t*, zmap_t*, zp_t /* key */);
+zmap_t *zMapPut(zgc_t*, zmap_t*, zp_t /* key */, zp_t /* value */);
+int zMapDel(zgc_t*, zmap_t*, zp_t /* key */);
+
+// HAMT: Persistent (immutable) hash map by object identity, which is a trie
+// of tuples. Put/Del return a new map sharing unchanged nodes with the old
+// one, and the old map is still valid. (Put returns NULL on failure) Get
+// returns NULL if there is no key, and key must not be NULL. A set is a map
+// whose values are keys.
+// Each calls fn for all pairs until fn returns non-zero, and returns it.
+// fn must not allocate objects.
+typedef int (*zhamtfn_t)(zp_t /* key */, zp_t /* value */, zp_t /* ud */);
+
+ztup_t *zAllocHamt(zgc_t*); // Empty map
+zp_t zHamtGet(zgc_t*, ztup_t*, zp_t /* key */);
+ztup_t *zHamtPut(zgc_t*, ztup_t*, zp_t /* key */, zp_t /* value */);
+ztup_t *zHamtDel(zgc_t*, ztup_t*, zp_t /* key */);
+int zHamtEach(ztup_t*, zhamtfn_t, zp_t /* ud */);
+zu_t zHamtCount(ztup_t*);
+
+// Ephemeron table: Weak-key map. A value is alive only while its key is
+// alive, and entries of collected keys are removed by GC. (NULL value is
+// same as no entry.) Use zMap* functions for tables.
+// As other mutable objects, an old table may refer younger keys, which
+// requires zAllowCyclicRefGC.
+zmap_t *zAllocEph(zgc_t*, zu_t /* capacity */);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+/* zzcore.hpp 0.0.1
+ * author: lumiknit */
+#ifndef __L_ZZCORE_HPP__
+#define __L_ZZCORE_HPP__
+
+// C++17 helpers for zzcore
+// - Frame: RAII root frame, Local: handle bound to a slot of Frame
+// - Root: handle bound to a slot of the bottom frame
+// - make<T>: allocation of an aggregate T, whose layout is computed at
+//   compile time. Every field must be a word, and pointer fields are refs.
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "zzcore.h"
+
+namespace zz {
+
+// -- Handles
+
+template<class T>
+class Handle {
+public:
+  T* get() const { return static_cast<T*>(slot->p); }
+  operator T*() const { return get(); }
+  T* operator->() const { return get(); }
+  T& operator*() const { return *get(); }
+  Handle& operator=(T *p) { slot->p = p; return *this; }
+  Handle(const Handle&) = delete;
+  Handle& operator=(const Handle &h) { slot->p = h.slot->p; return *this; }
+
+protected:
+  explicit Handle(ztag_t *slot) : slot(slot) {}
+  ztag_t *slot;
+};
+
+class Frame {
+public:
+  Frame(zgc_t *G, int size) : G(G), size(size), n(0) {
+    zGCPushFrame(G, size);
+  }
+  ~Frame() { zGCPopFrame(G); }
+  Frame(const Frame&) = delete;
+  Frame& operator=(const Frame&) = delete;
+
+  zgc_t* gc() const { return G; }
+  // Take the next slot (throws std::length_error if the frame is full)
+  ztag_t* take() {
+    if(n >= size) throw std::length_error("zz::Frame is full");
+    return zGCTopFrameSlot(G, n++);
+  }
+
+private:
+  zgc_t *G;
+  int size, n;
+};
+
+// Local must be in the scope of its frame, which must be the top frame
+// when the local is created.
+template<class T>
+class Local : public Handle<T> {
+public:
+  explicit Local(Frame &f, T *p = nullptr) : Handle<T>(f.take()) {
+    this->slot->p = p;
+  }
+  using Handle<T>::operator=;
+};
+
+// Root must be destroyed before the GC.
+template<class T>
+class Root : public Handle<T> {
+public:
+  Root(zgc_t *G, int idx, T *p = nullptr)
+    : Handle<T>(zGCBotFrameSlot(G, idx)) {
+    this->slot->p = p;
+  }
+  ~Root() { this->slot->p = nullptr; }
+  using Handle<T>::operator=;
+};
+
+// -- Layout
+
+namespace detail {
+
+struct Any {
+  template<class U> constexpr operator U() const noexcept;
+};
+template<std::size_t> using AnyAt = Any;
+
+template<class T, std::size_t... I>
+constexpr auto initializable(std::index_sequence<I...>, int)
+  -> decltype(T{AnyAt<I>{}...}, true) { return true; }
+template<class T, std::size_t... I>
+constexpr bool initializable(std::index_sequence<I...>, long) { return false; }
+
+template<class T, std::size_t N>
+constexpr std::size_t fieldCount() {
+  // The largest N s.t. T{x1, ..., xN} is valid
+  if constexpr(N == 0) return 0;
+  else if constexpr(initializable<T>(std::make_index_sequence<N>{}, 0)) return N;
+  else return fieldCount<T, N - 1>();
+}
+
+template<class... F> struct Fields {};
+
+#define ZZ_HPP_FIELDS(n, ...) \
+  else if constexpr(c == n) { \
+    auto &[__VA_ARGS__] = t; \
+    return fieldsOf(__VA_ARGS__); \
+  }
+
+template<class... F>
+Fields<std::remove_reference_t<F>...> fieldsOf(F&...);
+
+template<class T>
+auto fields(T &t) {
+  // Field types by structured bindings (never called)
+  constexpr std::size_t c = fieldCount<T, 16>();
+  if constexpr(c == 0) return Fields<>{};
+  ZZ_HPP_FIELDS(1, a)
+  ZZ_HPP_FIELDS(2, a, b)
+  ZZ_HPP_FIELDS(3, a, b, c0)
+  ZZ_HPP_FIELDS(4, a, b, c0, d)
+  ZZ_HPP_FIELDS(5, a, b, c0, d, e)
+  ZZ_HPP_FIELDS(6, a, b, c0, d, e, f)
+  ZZ_HPP_FIELDS(7, a, b, c0, d, e, f, g)
+  ZZ_HPP_FIELDS(8, a, b, c0, d, e, f, g, h)
+  ZZ_HPP_FIELDS(9, a, b, c0, d, e, f, g, h, i)
+  ZZ_HPP_FIELDS(10, a, b, c0, d, e, f, g, h, i, j)
+  ZZ_HPP_FIELDS(11, a, b, c0, d, e, f, g, h, i, j, k)
+  ZZ_HPP_FIELDS(12, a, b, c0, d, e, f, g, h, i, j, k, l)
+  ZZ_HPP_FIELDS(13, a, b, c0, d, e, f, g, h, i, j, k, l, m)
+  ZZ_HPP_FIELDS(14, a, b, c0, d, e, f, g, h, i, j, k, l, m, n)
+  ZZ_HPP_FIELDS(15, a, b, c0, d, e, f, g, h, i, j, k, l, m, n, o)
+  ZZ_HPP_FIELDS(16, a, b, c0, d, e, f, g, h, i, j, k, l, m, n, o, p)
+}
+
+#undef ZZ_HPP_FIELDS
+
+template<class... F>
+constexpr std::array<zb_t, sizeof...(F)> layoutOf(Fields<F...>) {
+  // 1 for non-pointer, 0 for pointer (same as zAllocLayout)
+  static_assert(((sizeof(F) == sizeof(zu_t)) && ...),
+    "Every field must be a word");
+  return {{ (std::is_pointer<F>::value ? (zb_t) 0 : (zb_t) 1)... }};
+}
+
+template<std::size_t N>
+constexpr zu_t dataPrefix(const std::array<zb_t, N> &b) {
+  // # of leading non-pointer words
+  zu_t i = 0;
+  while(i < N && b[i]) i++;
+  return i;
+}
+
+template<std::size_t N>
+constexpr bool ptrsFrom(const std::array<zb_t, N> &b, zu_t i) {
+  for(; i < N; i++) if(b[i]) return false;
+  return true;
+}
+
+} // namespace detail
+
+template<class T>
+struct Layout {
+  static_assert(std::is_aggregate<T>::value, "T must be an aggregate");
+  static constexpr auto bytes =
+    detail::layoutOf(decltype(detail::fields(std::declval<T&>())){});
+  static constexpr zu_t size = bytes.size();
+  static_assert(size > 0 && sizeof(T) == size * sizeof(zu_t),
+    "T must consist of words");
+  // Non-pointer words followed by pointers, which is the layout of zAlloc
+  static constexpr zu_t np = detail::dataPrefix(bytes);
+  static constexpr bool plain = detail::ptrsFrom(bytes, np);
+};
+
+// Allocate T initialized by args. Handles in args are read after allocation,
+// so pass objects as handles. (Raw pointers may be moved by GC)
+// Returns nullptr on failure.
+// A plain layout (data, then pointers) is chosen at compile time, and it is
+// exactly a zAlloc call. Other layouts are copied by zAllocLayout, as in C.
+template<class T, class... A>
+inline T* make(zgc_t *G, A&&... args) {
+  using L = Layout<T>;
+  zu_t *x;
+  if constexpr(L::plain) x = zAlloc(G, L::np, L::size - L::np);
+  else x = zAllocLayout(G, L::size, L::bytes.data());
+  if(x == nullptr) return nullptr;
+  return new(x) T{static_cast<decltype(args)>(args)...};
+}
+
+} // namespace zz
+
+#endif